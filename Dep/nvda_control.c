@@ -13,22 +13,41 @@ extern "C" {
 	static HANDLE g_hNvda = INVALID_HANDLE_VALUE;
 
 
-	// Function to escape quotes in the text
-	static void escape_quotes(const char* input, char* output, size_t output_size) {
-		size_t i, j = 0;
-		for (i = 0; input[i] != '\0' && j < output_size - 1; i++) {
-			if (input[i] == '"') {
-				// Escape the quote
-				if (j < output_size - 2) { // Check if there's space for escaped quote
-					output[j++] = '\\';
-					output[j++] = '"';
-				}
-			}
-			else {
-				output[j++] = input[i];
+	// Commands up to this size are built on the stack, which covers nearly all speech.
+#define NVDA_STACK_COMMAND_SIZE 4096
+
+	// Sends prefix, the text with its quotes escaped and suffix as one command.
+	// Longer commands are built in a heap buffer of the exact size instead of being cut off.
+	static int send_quoted_command(const char* prefix, const char* text, const char* suffix) {
+		char stack_command[NVDA_STACK_COMMAND_SIZE];
+		size_t prefix_length = strlen(prefix);
+		size_t suffix_length = strlen(suffix);
+		size_t size = prefix_length + suffix_length + 1;
+		const char* p;
+		for (p = text; *p != '\0'; p++) {
+			size += *p == '"' ? 2 : 1;
+		}
+
+		char* command = size <= sizeof(stack_command) ? stack_command : (char*)malloc(size);
+		if (command == NULL) {
+			return -1;
+		}
+		char* out = command;
+		memcpy(out, prefix, prefix_length);
+		out += prefix_length;
+		for (p = text; *p != '\0'; p++) {
+			if (*p == '"') {
+				*out++ = '\\'; // Escape the quote
 			}
+			*out++ = *p;
 		}
-		output[j] = '\0'; // Null-terminate the output string
+		memcpy(out, suffix, suffix_length + 1);
+
+		int result = nvda_send_command(command);
+		if (command != stack_command) {
+			free(command);
+		}
+		return result;
 	}
 
 
@@ -92,35 +111,23 @@ extern "C" {
 
 	// Sends a "speak" command to NVDA
 	int nvda_speak(const char* text, int symbol_level) {
-		char escaped_text[64000];
-		escape_quotes(text, escaped_text, sizeof(escaped_text));
-
-
-		char command[64000];
-		snprintf(command, sizeof(command), "speak \"%s\" 0 %d", escaped_text, symbol_level);
-		return nvda_send_command(command);
+		char suffix[32];
+		snprintf(suffix, sizeof(suffix), "\" 0 %d", symbol_level);
+		return send_quoted_command("speak \"", text, suffix);
 	}
 
 	// Sends a "speakSpelling" command to NVDA
 	int nvda_speak_spelling(const char* text, const char* locale, int use_character_descriptions) {
-		char escaped_text[64000];
-		escape_quotes(text, escaped_text, sizeof(escaped_text));
-
-
-		char command[64000];
-		snprintf(command, sizeof(command), "speakSpelling \"%s\" \"%s\" %d", escaped_text, locale, use_character_descriptions);
-		return nvda_send_command(command);
+		char suffix[128];
+		snprintf(suffix, sizeof(suffix), "\" \"%s\" %d", locale, use_character_descriptions);
+		return send_quoted_command("speakSpelling \"", text, suffix);
 	}
 
 	// Sends a "speakSsml" command to NVDA
 	int nvda_speak_ssml(const char* ssml, int symbol_level) {
-		char escaped_text[64000];
-		escape_quotes(ssml, escaped_text, sizeof(escaped_text));
-
-
-		char command[64000];
-		snprintf(command, sizeof(command), "speakSsml \"%s\" 0 %d", escaped_text, symbol_level);
-		return nvda_send_command(command);
+		char suffix[32];
+		snprintf(suffix, sizeof(suffix), "\" 0 %d", symbol_level);
+		return send_quoted_command("speakSsml \"", ssml, suffix);
 	}
 
 	// Sends a "pauseSpeech" command to NVDA
@@ -137,13 +144,7 @@ extern "C" {
 
 	// Sends a "braille" command to NVDA
 	int nvda_braille(const char* text) {
-		char escaped_text[64000];
-		escape_quotes(text, escaped_text, sizeof(escaped_text));
-
-
-		char command[64000];
-		snprintf(command, sizeof(command), "braille \"%s\"", escaped_text);
-		return nvda_send_command(command);
+		return send_quoted_command("braille \"", text, "\"");
 	}
 
 	// Function to check if NVDA is active
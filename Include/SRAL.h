@@ -147,9 +147,43 @@ SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH = 1 << 12
 	};
 
 
+	/**
+* @enum SRAL_ParamType
+* @brief The type of the value of an engine parameter, see SRAL_ParamValue.
+*/
+
+
+	enum SRAL_ParamType {
+		/** The parameter has no value that SRAL_ParamValue can hold, or it could not be read. */
+		SRAL_PARAM_TYPE_NONE = 0,
+		SRAL_PARAM_TYPE_INT,
+		SRAL_PARAM_TYPE_BOOL
+	};
+
+
+	/**
+* @struct SRAL_ParamValue
+* @brief An engine parameter and its value, see SRAL_SetEngineParameters.
+*/
+
+
+	typedef struct {
+		/** @brief One of SRAL_EngineParams. */
+		int param;
+		/** @brief One of SRAL_ParamType, which must match the parameter. */
+		int type;
+		union {
+			int int_value;
+			bool bool_value;
+		} value;
+	} SRAL_ParamValue;
+
+
+
 	/**
 * @struct SRAL_VoiceInfo
 * @brief Voice information values.
+* The strings belong to the engine and stay valid until it is uninitialized; listing the voices again returns the same pointers.
 */
 
 
@@ -163,6 +197,215 @@ SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH = 1 << 12
 
 
 
+	/**
+* @struct SRAL_LatencyDistribution
+* @brief Summary of a latency distribution. All durations are in microseconds.
+*/
+
+
+	typedef struct {
+		uint64_t count;
+		uint64_t min_us;
+		uint64_t mean_us;
+		uint64_t p50_us;
+		uint64_t p90_us;
+		uint64_t p99_us;
+		uint64_t max_us;
+	} SRAL_LatencyDistribution;
+
+
+
+	/**
+* @struct SRAL_LatencyStats
+* @brief Utterance latency of an engine, measured from the begin and end events reported by the engine itself.
+*/
+
+
+	typedef struct {
+		/** @brief From handing the utterance to the engine until the synthesizer started it. */
+		SRAL_LatencyDistribution submit_to_begin;
+		/** @brief From the start of the utterance until it finished playing. */
+		SRAL_LatencyDistribution begin_to_end;
+	} SRAL_LatencyStats;
+
+
+
+	/**
+* @struct SRAL_FailoverStats
+* @brief Counters of the failover policy, see SRAL_SetFailoverPolicy.
+*/
+
+
+	typedef struct {
+		/** @brief Calls where the selected engine failed. */
+		uint64_t failures;
+		/** @brief Failed calls that another engine then completed. */
+		uint64_t failovers;
+		/** @brief Failed calls for which no other engine succeeded within the latency budget. */
+		uint64_t exhausted;
+		/** @brief Times an engine was marked degraded. */
+		uint64_t degraded;
+	} SRAL_FailoverStats;
+
+
+	/**
+* @struct SRAL_QueueStats
+* @brief Counters of the output queue used by SRAL_Delay and SRAL_SpeakOnChannel.
+*/
+
+
+	typedef struct {
+		/** @brief Messages queued, including ones that replaced a pending message. */
+		uint64_t queued;
+		/** @brief Messages that replaced the pending message of their channel. */
+		uint64_t replaced;
+		/** @brief Messages passed to the engine. */
+		uint64_t spoken;
+		/** @brief Messages dropped because they expired before the engine was free, see SRAL_SetOutputTTL. */
+		uint64_t expired;
+		/** @brief Messages dropped because the queue was full, see SRAL_SetQueueLimits. */
+		uint64_t dropped;
+		/** @brief Messages merged into the message before them because the queue was full. */
+		uint64_t merged;
+		/** @brief Messages and scheduled speech removed by SRAL_Cancel and SRAL_CancelIf. */
+		uint64_t cancelled;
+		/** @brief Messages spoken as part of the utterance of an earlier message, see SRAL_SetAggregation. */
+		uint64_t aggregated;
+		/** @brief Messages currently waiting in the queue. */
+		uint64_t depth;
+		/** @brief The total size in bytes of the text currently waiting in the queue. */
+		uint64_t depth_bytes;
+	} SRAL_QueueStats;
+
+
+
+	/**
+* @struct SRAL_EngineStats
+* @brief Rolling averages that adaptive engine selection ranks engines by. Recent calls weigh the most.
+*/
+
+
+	typedef struct {
+		/** @brief Number of speak calls measured. */
+		uint64_t calls;
+		/** @brief Time spent inside the engine's speak call, in microseconds. */
+		uint64_t call_us;
+		/** @brief Time from submitting an utterance until speech started, in microseconds. 0 if the engine does not report it. */
+		uint64_t submit_to_begin_us;
+		/** @brief Fraction of speak calls that succeeded, from 0 to 1. */
+		double success_rate;
+	} SRAL_EngineStats;
+
+
+
+	/**
+* @enum SRAL_QueuePolicy
+* @brief What to do with new output when the output queue is full, see SRAL_SetQueueLimits.
+*/
+
+
+	enum SRAL_QueuePolicy {
+		/** Drop the oldest queued messages to make room. */
+		SRAL_QUEUE_DROP_OLDEST = 0,
+		/** Drop the new message. */
+		SRAL_QUEUE_DROP_NEWEST,
+		/** Wait for the queue to make room, and drop the new message if it does not within the timeout. */
+		SRAL_QUEUE_BLOCK,
+		/** Append the new message to the last queued one if both are plain speech for the same engine, otherwise drop the oldest. */
+		SRAL_QUEUE_MERGE
+	};
+
+
+	/**
+* @enum SRAL_OutputFlags
+* @brief Flags for SRAL_SpeakOnChannel and SRAL_SpeakAt.
+*/
+
+
+	enum SRAL_OutputFlags {
+		SRAL_OUTPUT_INTERRUPT = 1 << 0,
+		SRAL_OUTPUT_SSML = 1 << 1
+	};
+
+
+	/**
+* @enum SRAL_InitFlags
+* @brief Flags for SRAL_InitializeEx.
+*/
+
+
+	enum SRAL_InitFlags {
+		/** Start no threads. Engines start one after another, and queued, scheduled and held output, utterance callbacks and engine reconnects are all handled by SRAL_Pump. */
+		SRAL_INIT_PUMP = 1 << 0
+	};
+
+
+	/**
+* @enum SRAL_UtteranceParamFlags
+* @brief Which values of SRAL_UtteranceParams to apply.
+*/
+
+
+	enum SRAL_UtteranceParamFlags {
+		SRAL_UTTERANCE_RATE = 1 << 0,
+		SRAL_UTTERANCE_VOLUME = 1 << 1,
+		SRAL_UTTERANCE_VOICE = 1 << 2
+	};
+
+
+	/**
+* @struct SRAL_UtteranceParams
+* @brief Parameters for a single message, see SRAL_SpeakWithParams. Values are in the units of the matching SRAL_EngineParams.
+*/
+
+
+	typedef struct {
+		/** @brief A combination of SRAL_UtteranceParamFlags. Values without their flag are ignored. */
+		int flags;
+		/** @brief As SRAL_PARAM_SPEECH_RATE. */
+		int rate;
+		/** @brief As SRAL_PARAM_SPEECH_VOLUME. */
+		int volume;
+		/** @brief As SRAL_PARAM_VOICE_INDEX. */
+		int voice_index;
+		/** @brief Whether to interrupt the current speech. */
+		bool interrupt;
+	} SRAL_UtteranceParams;
+
+
+	/**
+* @brief Text filter callback, see SRAL_AddTextFilter.
+* @param text The text about to be output.
+* @param user_data The pointer passed to SRAL_AddTextFilter.
+* @return The text to output instead, or NULL to drop the message. The returned string must stay valid until the next call of the filter.
+*/
+
+
+	typedef const char* (*SRAL_TextFilter)(const char* text, void* user_data);
+
+
+	/**
+* @brief Utterance callback, see SRAL_SetUtteranceCallback.
+* @param utterance_id The identifier of the message that has been spoken.
+* @param user_data The pointer passed to SRAL_SetUtteranceCallback.
+*/
+
+
+	typedef void (*SRAL_UtteranceCallback)(uint64_t utterance_id, void* user_data);
+
+
+	/**
+* @brief Allocator callbacks, see SRAL_SetAllocator. They behave like malloc, realloc and free.
+* @param user_data The pointer passed to SRAL_SetAllocator.
+*/
+
+
+	typedef void* (*SRAL_AllocFunc)(size_t size, void* user_data);
+	typedef void* (*SRAL_ReallocFunc)(void* memory, size_t size, void* user_data);
+	typedef void (*SRAL_FreeFunc)(void* memory, void* user_data);
+
+
+
 	/**
 * Functions for memory management.
 */
@@ -176,6 +419,15 @@ SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH = 1 << 12
 
 	SRAL_API void* SRAL_malloc(size_t size);
 
+/**
+* @brief Resize memory allocated with SRAL_malloc.
+* @param memory A pointer to the allocated memory, or NULL to allocate new memory.
+* @param size The new size in bytes.
+* @return a pointer to the resized buffer, or NULL if it could not be resized, in which case memory is left as it was.
+*/
+
+	SRAL_API void* SRAL_realloc(void* memory, size_t size);
+
 /**
 * @brief Free the allocated memory.
 * @param memory A pointer to the allocated memory.
@@ -183,6 +435,22 @@ SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH = 1 << 12
 
 	SRAL_API void SRAL_free(void* memory);
 
+/**
+* @brief Set the allocator used for the memory SRAL hands out and for some of its own long-lived storage.
+* This covers SRAL_malloc, SRAL_realloc, the buffers returned by SRAL_SpeakToMemory, the voice information strings and the
+* slot tables of the output queue and of the scheduled output. Everything else, including the text held in those slots,
+* the engines and the memory of the screen readers and speech APIs SRAL talks to, still comes from the default heap.
+* Memory allocated before the change is still freed with the allocator it came from, so the allocator can be set at any time.
+* @param alloc The allocation function.
+* @param realloc The reallocation function.
+* @param free The function that frees memory.
+* @param user_data A pointer passed to each of the functions.
+* Pass NULL for all three functions to go back to malloc, realloc and free.
+* @return true if the allocator was set, false if only some of the functions are NULL.
+*/
+
+	SRAL_API bool SRAL_SetAllocator(SRAL_AllocFunc alloc, SRAL_ReallocFunc realloc, SRAL_FreeFunc free, void* user_data);
+
 
 	/**
 * Functions for interacting with the currently available and active engine (auto update).
@@ -213,7 +481,7 @@ SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH = 1 << 12
 
 
 * @return a pointer to the PCM buffer if speaking was successful, false otherwise.
-* The caller is responsable to free the memory
+* The caller is responsable to free the memory with SRAL_free
 */
 
 	SRAL_API void* SRAL_SpeakToMemory(const char* text, uint64_t* buffer_size, int* channels, int* sample_rate, int* bits_per_sample);
@@ -238,6 +506,128 @@ SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH = 1 << 12
 
 	SRAL_API bool SRAL_Braille(const char* text);
 
+
+	/**
+* @brief Speak a message with its own rate, volume or voice, leaving the engine's settings as they are for other messages.
+* Engines that support SSML get the parameters as markup within the message. Other engines have them set before the message
+* and restored right after it.
+* @param text A pointer to the text string to be spoken.
+* @param params The parameters for this message.
+* @return true if speaking was successful, false otherwise.
+*/
+
+
+	SRAL_API bool SRAL_SpeakWithParams(const char* text, const SRAL_UtteranceParams* params);
+
+
+	/**
+* @brief Queue speech on a named output channel, such as a status bar, a chat or a combat log.
+* Queued speech is spoken in order by a background thread, each message after the engine has stopped speaking (and after the time set by SRAL_Delay).
+* A new message on a channel replaces the channel's message that has not been spoken yet, keeping its place in the queue, so only the latest value is spoken.
+* @param channel_id A non-negative number identifying the channel, chosen by the caller.
+* @param text The text or, with SRAL_OUTPUT_SSML, the SSML to speak.
+* @param flags A combination of SRAL_OutputFlags. With SRAL_OUTPUT_INTERRUPT the message interrupts the speech in progress when its turn comes.
+* @return An identifier of the queued message for SRAL_Cancel, or 0 if it was not queued.
+*/
+
+
+	SRAL_API uint64_t SRAL_SpeakOnChannel(int channel_id, const char* text, int flags);
+
+
+	/**
+* @brief Get the time of the monotonic clock used by SRAL_SpeakAt.
+* @return The time in nanoseconds since an unspecified point.
+*/
+
+
+	SRAL_API uint64_t SRAL_GetMonotonicTime(void);
+
+
+	/**
+* @brief Schedule speech at an absolute time.
+* Scheduled speech does not go through the output queue: it is passed to the engine when it is due, whether or not the engine is speaking, and never before.
+* Scheduling is O(1) and timers fire within a fraction of a millisecond, so thousands of cues (such as rhythm game or tutorial timings) can be scheduled at once.
+* Stopping speech does not cancel scheduled speech; uninitializing the library does.
+* @param engine The engine to speak with, or 0 for the current engine.
+* @param text The text or, with SRAL_OUTPUT_SSML, the SSML to speak.
+* @param monotonic_deadline_ns When to speak, in nanoseconds of SRAL_GetMonotonicTime. A time in the past speaks at once.
+* @param flags A combination of SRAL_OutputFlags.
+* @return An identifier of the scheduled speech for SRAL_Cancel, or 0 if it could not be scheduled.
+*/
+
+
+	SRAL_API uint64_t SRAL_SpeakAt(int engine, const char* text, uint64_t monotonic_deadline_ns, int flags);
+
+
+	/**
+* @brief Schedule speech after a delay, see SRAL_SpeakAt.
+* @param engine The engine to speak with, or 0 for the current engine.
+* @param text The text or, with SRAL_OUTPUT_SSML, the SSML to speak.
+* @param delay_ns The delay from now in nanoseconds.
+* @param flags A combination of SRAL_OutputFlags.
+* @return An identifier of the scheduled speech for SRAL_Cancel, or 0 if it could not be scheduled.
+*/
+
+
+	SRAL_API uint64_t SRAL_SpeakAfter(int engine, const char* text, uint64_t delay_ns, int flags);
+
+
+	/**
+* @brief Tag queued and scheduled speech, so that it can be cancelled as a group with SRAL_CancelIf.
+* The tag applies to speech queued (with SRAL_Delay or SRAL_SpeakOnChannel) or scheduled (with SRAL_SpeakAt) after this call.
+* @param tag A number chosen by the caller, or 0 for no tag (the default).
+*/
+
+
+	SRAL_API void SRAL_SetOutputTag(int tag);
+
+
+	/**
+* @brief Cancel a queued or scheduled utterance without disturbing the rest of the queue.
+* If the utterance has already been passed to the engine and is the last one that was, speech is stopped if the engine is still speaking.
+* @param utterance_id The identifier returned by SRAL_SpeakOnChannel, SRAL_SpeakAt or SRAL_SpeakAfter.
+* @return true if the utterance was cancelled, false if it was not found.
+*/
+
+
+	SRAL_API bool SRAL_Cancel(uint64_t utterance_id);
+
+
+	/**
+* @brief Cancel all queued or scheduled utterances with a tag, see SRAL_SetOutputTag and SRAL_Cancel.
+* @param tag The tag, not 0.
+* @return The number of utterances cancelled.
+*/
+
+
+	SRAL_API int SRAL_CancelIf(int tag);
+
+
+	/**
+* @brief Aggregate adjacent short queued messages into a single engine call.
+* When the output queue gets to a message, the plain, non-interrupting messages queued right behind it for the same engine are spoken with it
+* as one SSML utterance, in order, separated by breaks. Each message is followed by an SSML mark, see SRAL_SetUtteranceCallback.
+* Only engines that support SSML aggregate messages. Disabled by default.
+* @param max_bytes The maximum total size of the text of the aggregated messages, or 0 to disable aggregation.
+* @param timeout_ms How long to wait for more messages to arrive before speaking what has been aggregated.
+* @param break_ms The length of the break between messages in milliseconds, or 0 for none.
+* @return true if aggregation was configured, false if an argument is invalid.
+*/
+
+
+	SRAL_API bool SRAL_SetAggregation(int max_bytes, int timeout_ms, int break_ms);
+
+
+	/**
+* @brief Set a function to be called when the engine has finished speaking a message of an aggregated utterance.
+* The call comes from the engine's SSML mark following the message, on a thread of the engine. Only engines that report marks call it (currently Speech Dispatcher).
+* @param callback The callback, or NULL to remove it.
+* @param user_data A pointer passed to every call of the callback.
+*/
+
+
+	SRAL_API void SRAL_SetUtteranceCallback(SRAL_UtteranceCallback callback, void* user_data);
+
 	/**
  * @brief Output text using all currently supported speech engine methods.
  * @param text A pointer to the text string to be output.
@@ -333,6 +723,32 @@ SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH = 1 << 12
 	SRAL_API bool SRAL_GetEngineParameter(int engine, int param, void* value);
 
 
+	/**
+* @brief Set several parameters of an engine at once, for example a whole voice profile.
+* A voice index is applied before the other values, since selecting a voice may reset them. No speech from SRAL
+* goes to the engine until all values are applied.
+* @param engine The engine to configure, or 0 for the current engine.
+* @param values The parameters and their values. Values whose type does not match their parameter are skipped.
+* @param count The number of values.
+* @return The number of values that were applied.
+*/
+
+
+	SRAL_API int SRAL_SetEngineParameters(int engine, const SRAL_ParamValue* values, int count);
+
+
+	/**
+* @brief Get several parameters of an engine at once.
+* @param engine The engine to query, or 0 for the current engine.
+* @param values The parameters to get. Their type and value are filled in; the type is SRAL_PARAM_TYPE_NONE if a value could not be read.
+* @param count The number of values.
+* @return The number of values that were read.
+*/
+
+
+	SRAL_API int SRAL_GetEngineParameters(int engine, SRAL_ParamValue* values, int count);
+
+
 
 	/**
  * @brief Initialize the library and optionally exclude certain engines.
@@ -343,6 +759,17 @@ SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH = 1 << 12
 
 	SRAL_API bool SRAL_Initialize(int engines_exclude);
 
+
+	/**
+ * @brief Initialize the library with the given flags.
+ * @param engines_exclude A bitmask specifying engines to exclude from auto update.
+ * @param flags A combination of SRAL_InitFlags.
+ * @return true if initialization was successful, false otherwise.
+ */
+
+
+	SRAL_API bool SRAL_InitializeEx(int engines_exclude, int flags);
+
 	/**
  * @brief Uninitialize the library, freeing resources.
  */
@@ -377,7 +804,7 @@ SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH = 1 << 12
 * @param bits_per_sample A pointer to int to write PCM bit size (floating point or signed integer).
 
 * @return a pointer to the PCM buffer if speaking was successful, false otherwise.
-* The caller is responsable to free the memory
+* The caller is responsable to free the memory with SRAL_free
 */
 
 	SRAL_API void* SRAL_SpeakToMemoryEx(int engine, const char* text, uint64_t* buffer_size, int* channels, int* sample_rate, int* bits_per_sample);
@@ -395,6 +822,18 @@ SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH = 1 << 12
 	SRAL_API bool SRAL_SpeakSsmlEx(int engine, const char* ssml, bool interrupt);
 
 
+	/**
+* @brief Speak a message with its own parameters using a specified engine, see SRAL_SpeakWithParams.
+* @param engine The engine to use for speaking.
+* @param text A pointer to the text string to be spoken.
+* @param params The parameters for this message.
+* @return true if speaking was successful, false otherwise.
+*/
+
+
+	SRAL_API bool SRAL_SpeakWithParamsEx(int engine, const char* text, const SRAL_UtteranceParams* params);
+
+
 
 
 	/**
@@ -512,6 +951,7 @@ SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH = 1 << 12
 
 	/**
 * @brief Get all active engines that can be used.
+* The mask reflects the state each engine last reported; it is maintained as engines are used, so this call never contacts a screen reader.
 * @return Bitmask with active engines.
 */
 
@@ -551,6 +991,289 @@ SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH = 1 << 12
 
 
 
+	/**
+* @brief Get utterance latency statistics for the specified engine.
+* Only engines that report speech begin/end events collect samples (currently Speech Dispatcher and SAPI);
+* for the others the distributions stay empty.
+* @param engine The engine to query. 0 means the current engine.
+* @param stats An out pointer to write the statistics.
+* @return true if the statistics were retrieved successfully, false otherwise.
+*/
+
+
+	SRAL_API bool SRAL_GetLatencyStats(int engine, SRAL_LatencyStats* stats);
+
+
+	/**
+* @brief Discard the latency statistics collected for the specified engine.
+* @param engine The engine to reset. 0 means the current engine.
+*/
+
+
+	SRAL_API void SRAL_ResetLatencyStats(int engine);
+
+
+
+	/**
+* @brief Start or stop recording trace events (public calls, engine calls, queue waits and engine events).
+* Tracing is only compiled in when SRAL is built with the SRAL_ENABLE_TRACING option.
+* @param enable true to start recording, false to stop.
+* @return true if tracing is available in this build, false otherwise.
+*/
+
+
+	SRAL_API bool SRAL_SetTracing(bool enable);
+
+
+	/**
+* @brief Write the recorded trace events to a file in Chrome trace-event JSON format.
+* The file can be opened in chrome://tracing or https://ui.perfetto.dev.
+* Each thread keeps only its most recent events.
+* @param path The path of the file to write.
+* @return true if the trace was written successfully, false otherwise.
+*/
+
+
+	SRAL_API bool SRAL_DumpTrace(const char* path);
+
+
+	/**
+* @brief Get the number of heap allocations (operator new calls and memory taken from the SRAL_SetAllocator hooks) the calling thread has made so far.
+* Read it before and after a call to check that the call does not allocate; once warmed up, speaking text
+* directly on an engine should not.
+* Counting is only compiled in when SRAL is built with the SRAL_COUNT_ALLOCATIONS option, which is meant for tests.
+* @param count Receives the number of allocations.
+* @return true if allocation counting is available in this build, false otherwise.
+*/
+
+
+	SRAL_API bool SRAL_GetAllocationCount(uint64_t* count);
+
+
+
+	/**
+* @brief Start recording every public SRAL call (time, thread, engine, arguments and text size) to a binary file.
+* The text itself is not stored. Recordings can be replayed with the sral-replay tool.
+* If a recording is already in progress, it is closed and a new one is started.
+* @param path The path of the file to write.
+* @return true if the file was created successfully, false otherwise.
+*/
+
+
+	SRAL_API bool SRAL_StartRecording(const char* path);
+
+
+	/**
+* @brief Stop recording and close the recording file.
+*/
+
+
+	SRAL_API void SRAL_StopRecording(void);
+
+
+	/**
+* @brief Wait until every engine has finished starting.
+* SRAL_Initialize starts the engines concurrently and returns as soon as one of them is usable;
+* the rest finish in the background. Calls that name a specific engine wait for that engine automatically.
+* @param timeout The maximum time to wait in milliseconds, or -1 to wait indefinitely.
+* @return true if no engine is still starting, false if the timeout expired.
+*/
+
+
+	SRAL_API bool SRAL_WaitForEngines(int timeout);
+
+
+	/**
+* @brief Get the time an engine took to initialize.
+* @param engine The engine to query.
+* @return The initialization time in microseconds, or -1 if the engine is unknown or still starting.
+*/
+
+
+	SRAL_API int64_t SRAL_GetEngineStartupTime(int engine);
+
+
+	/**
+* @brief Configure failover for the functions that select the engine automatically (SRAL_Speak, SRAL_SpeakSsml, SRAL_Braille and SRAL_Output).
+* When the current engine fails a call, the call is retried on the next active engine with the required feature,
+* and the failing engine is marked degraded: automatic engine selection skips it until the cooldown expires.
+* Functions taking an explicit engine are never redirected. Failover is disabled by default.
+* @param enabled true to enable failover, false to disable it.
+* @param budget_ms The maximum time in milliseconds spent retrying one call on other engines.
+* @param cooldown_ms How long in milliseconds a failing engine stays degraded.
+*/
+
+
+	SRAL_API void SRAL_SetFailoverPolicy(bool enabled, int budget_ms, int cooldown_ms);
+
+
+	/**
+* @brief Get the failover counters.
+* @param stats Pointer to a structure that receives the counters.
+* @return true if the counters were copied, false if stats is NULL.
+*/
+
+
+	SRAL_API bool SRAL_GetFailoverStats(SRAL_FailoverStats* stats);
+
+
+	/**
+* @brief Reset the failover counters and clear the degraded state of every engine.
+*/
+
+
+	SRAL_API void SRAL_ResetFailoverStats(void);
+
+
+	/**
+* @brief Set how long queued output stays relevant.
+* Output queued after this call (with SRAL_Delay or SRAL_SpeakOnChannel) that cannot be spoken within ttl_ms, for example because the engine is still speaking,
+* is dropped instead of being spoken late. Output that is not queued is not affected.
+* @param ttl_ms The time to live in milliseconds, or 0 to keep queued output until it is spoken (the default).
+*/
+
+
+	SRAL_API void SRAL_SetOutputTTL(int ttl_ms);
+
+
+	/**
+* @brief Get the counters of the output queue.
+* @param stats A pointer to the structure to fill.
+* @return true on success, false if stats is NULL.
+*/
+
+
+	SRAL_API bool SRAL_GetQueueStats(SRAL_QueueStats* stats);
+
+
+	/**
+* @brief Reset the counters of the output queue.
+*/
+
+
+	SRAL_API void SRAL_ResetQueueStats(void);
+
+
+	/**
+* @brief Bound the output queue used by SRAL_Delay and SRAL_SpeakOnChannel.
+* A message on a channel that replaces the channel's pending message never counts as new. The queue is unbounded by default.
+* @param max_items The maximum number of queued messages, or 0 for no limit.
+* @param max_bytes The maximum total size of queued text in bytes, or 0 for no limit. A larger message is still queued when the queue is empty.
+* @param policy What to do when the queue is full, defined by the SRAL_QueuePolicy enumeration.
+* @param timeout_ms How long SRAL_QUEUE_BLOCK waits for room, in milliseconds.
+* @return true if the limits were set, false if an argument is invalid.
+*/
+
+
+	SRAL_API bool SRAL_SetQueueLimits(int max_items, int max_bytes, int policy, int timeout_ms);
+
+
+	/**
+* @brief Set the order in which the functions without an engine parameter try engines.
+* Listed engines are preferred in the given order; the others follow in the default order, or ranked by measurements if adaptive selection is enabled.
+* The Narrator special case on Windows still applies.
+* @param order Array of engine identifiers, from most to least preferred.
+* @param count Number of elements in the array. Pass 0 to return to the default order.
+* @return true if the order was set, false if an element is not a single engine.
+*/
+
+
+	SRAL_API bool SRAL_SetEnginePriority(const int* order, int count);
+
+
+	/**
+* @brief Enable or disable adaptive engine selection.
+* When enabled, engines not pinned with SRAL_SetEnginePriority are ranked by the time it takes them to start speaking
+* and by how often their calls succeed (see SRAL_GetEngineStats), and the best active engine is used.
+* Engines that have not been measured yet are tried first. Disabled by default.
+* @param enable true to enable adaptive selection, false to disable it.
+*/
+
+
+	SRAL_API void SRAL_SetAdaptiveEngineSelection(bool enable);
+
+
+	/**
+* @brief Get the rolling statistics of an engine. They are cleared by SRAL_ResetLatencyStats.
+* @param engine The engine to query, or 0 for the current engine.
+* @param stats Pointer to a structure that receives the statistics.
+* @return true if the statistics were copied, false otherwise.
+*/
+
+
+	SRAL_API bool SRAL_GetEngineStats(int engine, SRAL_EngineStats* stats);
+
+
+	/**
+* @brief Add a text filter to an engine's middleware chain.
+* The filter sees the text of every speech, speak to memory and braille call (not SSML) before the engine does.
+* Middleware added later runs first. Middleware must not be configured while another thread is outputting through the same engine.
+* @param engine The engine to filter, or 0 for every available engine.
+* @param filter The callback.
+* @param user_data A pointer passed to every call of the filter.
+* @return true if the filter was added, false otherwise.
+*/
+
+
+	SRAL_API bool SRAL_AddTextFilter(int engine, SRAL_TextFilter filter, void* user_data);
+
+
+	/**
+* @brief Add a rate limit to an engine's middleware chain.
+* Speech is limited to max_per_second utterances on average, with bursts of up to burst utterances.
+* Utterances over the limit are dropped unless they interrupt.
+* @param engine The engine to limit, or 0 for every available engine.
+* @param max_per_second The average number of utterances allowed per second.
+* @param burst The number of utterances allowed in a burst.
+* @return true if the limit was added, false otherwise.
+*/
+
+
+	SRAL_API bool SRAL_AddRateLimit(int engine, int max_per_second, int burst);
+
+
+	/**
+* @brief Add a coalescing stage to an engine's middleware chain, for announcements that fire many times per second.
+* Within window_ms of a message being spoken, the same message is dropped. A message that only differs from it in its numbers
+* (for example "Health 50" and "Health 45") is held back and spoken when the window ends; a newer such message replaces the held one.
+* The first message of a burst is spoken immediately. Stopping speech discards held messages.
+* @param engine The engine to coalesce speech for, or 0 for every available engine.
+* @param window_ms The window in milliseconds.
+* @return true if the coalescer was added, false otherwise.
+*/
+
+
+	SRAL_API bool SRAL_AddCoalescer(int engine, int window_ms);
+
+
+	/**
+* @brief Remove all middleware from an engine, so that it is called directly again.
+* @param engine The engine, or 0 for every available engine.
+*/
+
+
+	SRAL_API void SRAL_ClearMiddleware(int engine);
+
+
+	/**
+* @brief Do the work that would otherwise run on SRAL's own threads, when initialized with SRAL_INIT_PUMP.
+* Speaks queued output whose engine has been quiet for its delay, fires scheduled output that is due, speaks held coalesced messages,
+* delivers utterance callbacks and checks engine connections. Never sleeps or waits for more output to aggregate.
+* Call it regularly from one thread, for example once per frame. With SRAL_QUEUE_BLOCK, a full queue only makes room when this is called.
+* Some engines still play audio on a thread of their own (SAPI) or through their library's (Speech Dispatcher).
+* @param max_time_us The time budget in microseconds, or 0 for no limit. Work stops once it is spent; the last item may overrun it.
+* @return The number of messages spoken and callbacks delivered, or 0 if the library is not initialized in pump mode.
+*/
+
+
+	SRAL_API int SRAL_Pump(uint64_t max_time_us);
+
+
+
+
+
+
+
 #ifdef __cplusplus
 }// extern "C"
 #endif
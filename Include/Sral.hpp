@@ -223,17 +223,26 @@ extern "C++" {
 				return result; 
 			}
 
-			SRAL_VoiceInfo* raw_voice_array = new SRAL_VoiceInfo[count];
+			SRAL_VoiceInfo* raw_voice_array = static_cast<SRAL_VoiceInfo*>(SRAL_malloc(count * sizeof(SRAL_VoiceInfo)));
+			if (!raw_voice_array) return result;
+			// Engines may fill fewer entries than they counted.
+			for (int i = 0; i < count; ++i) {
+				raw_voice_array[i] = SRAL_VoiceInfo{};
+			}
 
-			if (!SRAL_GetEngineParameter(engine_id, SRAL_PARAM_VOICE_PROPERTIES, &raw_voice_array)) {
+			if (!SRAL_GetEngineParameter(engine_id, SRAL_PARAM_VOICE_PROPERTIES, raw_voice_array)) {
+				SRAL_free(raw_voice_array);
 				return result;
 			}
 
-			if (!raw_voice_array) return result;
-
-			result.reserve(count);
-			for (int i = 0; i < count; ++i) {
-				result.emplace_back(raw_voice_array[i]);
+			try {
+				result.reserve(count);
+				for (int i = 0; i < count; ++i) {
+					result.emplace_back(raw_voice_array[i]);
+				}
+			} catch (...) {
+				SRAL_free(raw_voice_array);
+				throw;
 			}
 
 			SRAL_free(raw_voice_array);
@@ -103,7 +103,7 @@ bool AvSpeech::Initialize() {
 }
 
 bool AvSpeech::Uninitialize() {
-	ReleaseAllStrings();
+	m_strings.Clear();
 	if (obj == nullptr) return false; // Check for nullptr
 	delete obj;
 	obj = nullptr; // Set to nullptr after deletion
@@ -152,12 +152,11 @@ bool AvSpeech::GetParameter(int param, void* value) {
 		return true;
 	}
 	case SRAL_PARAM_VOICE_PROPERTIES: {
-		ReleaseAllStrings();
 		int voice_count = obj->GetVoiceCount();
 		SRAL_VoiceInfo* voices = (SRAL_VoiceInfo*)value;
 		for (int i = 0; i < voice_count; ++i) {
 			const char* desc = obj->GetVoiceName(i);
-			voices[i].name = AddString(desc);
+			voices[i].name = m_strings.Intern(desc);
 		}
 	return true;
 	}
@@ -0,0 +1,183 @@
+#include "Allocations.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#ifdef SRAL_COUNT_ALLOCATIONS
+#include <cstdlib>
+#endif
+
+namespace Sral {
+	namespace Allocations {
+		namespace {
+			struct Hooks {
+				SRAL_AllocFunc alloc;
+				SRAL_ReallocFunc realloc;
+				SRAL_FreeFunc free;
+				void* user_data;
+				const Hooks* next;
+			};
+
+#ifdef SRAL_COUNT_ALLOCATIONS
+			// A plain thread_local, so that counting never allocates or locks itself.
+			thread_local uint64_t t_count = 0;
+#endif
+
+			void* default_alloc(size_t size, void*) {
+				return malloc(size);
+			}
+
+			void* default_realloc(void* memory, size_t size, void*) {
+				return realloc(memory, size);
+			}
+
+			void default_free(void* memory, void*) {
+				free(memory);
+			}
+
+			const Hooks g_defaultHooks{default_alloc, default_realloc, default_free, nullptr, nullptr};
+			// Every hook set that has been installed. They are never freed, since blocks allocated with them may
+			// outlive any change; setting the same hooks again reuses the set.
+			std::mutex g_setsMutex;
+			const Hooks* g_sets = &g_defaultHooks;
+			std::atomic<const Hooks*> g_hooks{&g_defaultHooks};
+
+			// Every block starts with the hooks it came from, padded so that the memory after it stays aligned.
+			constexpr size_t kHeaderSize = alignof(max_align_t);
+			static_assert(kHeaderSize >= sizeof(const Hooks*), "block header too small");
+
+			void* prepare(void* block, const Hooks* hooks) {
+				if (block == nullptr) return nullptr;
+				memcpy(block, &hooks, sizeof(hooks));
+				return static_cast<char*>(block) + kHeaderSize;
+			}
+
+			const Hooks* block_hooks(void* memory, void** block) {
+				*block = static_cast<char*>(memory) - kHeaderSize;
+				const Hooks* hooks;
+				memcpy(&hooks, *block, sizeof(hooks));
+				return hooks;
+			}
+		}
+
+		bool Set(SRAL_AllocFunc alloc, SRAL_ReallocFunc realloc, SRAL_FreeFunc free, void* user_data) {
+			const bool reset = alloc == nullptr && realloc == nullptr && free == nullptr;
+			if (!reset && (alloc == nullptr || realloc == nullptr || free == nullptr)) return false;
+			if (reset) {
+				g_hooks.store(&g_defaultHooks);
+				return true;
+			}
+			std::lock_guard<std::mutex> lock(g_setsMutex);
+			const Hooks* hooks = g_sets;
+			while (hooks != nullptr && (hooks->alloc != alloc || hooks->realloc != realloc || hooks->free != free || hooks->user_data != user_data)) {
+				hooks = hooks->next;
+			}
+			if (hooks == nullptr) {
+				hooks = new Hooks{alloc, realloc, free, user_data, g_sets};
+				g_sets = hooks;
+			}
+			g_hooks.store(hooks);
+			return true;
+		}
+
+		void* Allocate(size_t size) {
+#ifdef SRAL_COUNT_ALLOCATIONS
+			t_count++;
+#endif
+			const Hooks* hooks = g_hooks.load();
+			return prepare(hooks->alloc(size + kHeaderSize, hooks->user_data), hooks);
+		}
+
+		void* Reallocate(void* memory, size_t size) {
+			if (memory == nullptr) return Allocate(size);
+			void* block;
+#ifdef SRAL_COUNT_ALLOCATIONS
+			t_count++;
+#endif
+			const Hooks* hooks = block_hooks(memory, &block);
+			return prepare(hooks->realloc(block, size + kHeaderSize, hooks->user_data), hooks);
+		}
+
+		void Free(void* memory) {
+			if (memory == nullptr) return;
+			void* block;
+			const Hooks* hooks = block_hooks(memory, &block);
+			hooks->free(block, hooks->user_data);
+		}
+
+#ifdef SRAL_COUNT_ALLOCATIONS
+		bool Count(uint64_t* count) {
+			*count = t_count;
+			return true;
+		}
+#else
+		bool Count(uint64_t*) {
+			return false;
+		}
+#endif
+	}
+}
+
+#ifdef SRAL_COUNT_ALLOCATIONS
+// Over-aligned allocations keep the default operators and are not counted; nothing in SRAL makes them.
+static void* counted_allocate(std::size_t size) {
+	Sral::Allocations::t_count++;
+	if (size == 0) size = 1;
+	for (;;) {
+		void* p = std::malloc(size);
+		if (p != nullptr) return p;
+		std::new_handler handler = std::get_new_handler();
+		if (handler == nullptr) throw std::bad_alloc();
+		handler();
+	}
+}
+
+static void* counted_allocate_nothrow(std::size_t size) noexcept {
+	try {
+		return counted_allocate(size);
+	}
+	catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new(std::size_t size) {
+	return counted_allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+	return counted_allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return counted_allocate_nothrow(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return counted_allocate_nothrow(size);
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+	std::free(p);
+}
+#endif
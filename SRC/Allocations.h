@@ -0,0 +1,61 @@
+#ifndef ALLOCATIONS_H_
+#define ALLOCATIONS_H_
+#pragma once
+#include "../Include/SRAL.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+
+// The allocator set with SRAL_SetAllocator, and counting of heap allocations.
+// Counting is for checking that speaking does not allocate once SRAL has warmed up. It is only compiled in when
+// SRAL is built with SRAL_COUNT_ALLOCATIONS, which replaces the global operator new of the program (of the
+// library only, for a DLL) with one that counts the calls made by each thread. Allocate and Reallocate are
+// counted too, since the hooks they call are not operator new.
+
+namespace Sral {
+	namespace Allocations {
+		// Sets count to the number of allocations made by the calling thread so far.
+		// Returns false if counting is not compiled in.
+		bool Count(uint64_t* count);
+
+		// Installs the hooks, or malloc, realloc and free if all of them are null. Each block remembers the hooks
+		// it came from, so memory allocated before a change is still freed with the right function.
+		bool Set(SRAL_AllocFunc alloc, SRAL_ReallocFunc realloc, SRAL_FreeFunc free, void* user_data);
+
+		// Memory that is handed to callers or may be freed with SRAL_free must come from here.
+		void* Allocate(size_t size);
+		// size must not be 0.
+		void* Reallocate(void* memory, size_t size);
+		void Free(void* memory);
+
+		// For containers whose storage should come from the hooks too.
+		template <typename T>
+		struct Allocator {
+			using value_type = T;
+
+			Allocator() = default;
+			template <typename U>
+			Allocator(const Allocator<U>&) {}
+
+			T* allocate(size_t n) {
+				void* memory = Allocate(n * sizeof(T));
+				if (memory == nullptr) throw std::bad_alloc();
+				return static_cast<T*>(memory);
+			}
+			void deallocate(T* p, size_t) {
+				Free(p);
+			}
+
+			template <typename U>
+			bool operator==(const Allocator<U>&) const {
+				return true;
+			}
+			template <typename U>
+			bool operator!=(const Allocator<U>&) const {
+				return false;
+			}
+		};
+	}
+}
+
+#endif
@@ -34,7 +34,7 @@ bool AndroidAccessibilityManager::Initialize() {
 }
 
 bool AndroidAccessibilityManager::Uninitialize() {
-	ReleaseAllStrings();
+	m_strings.Clear();
 	if (env && announcerObj) {
 		if (midShutdown) env->CallVoidMethod(announcerObj, midShutdown);
 		env->DeleteGlobalRef(announcerObj);
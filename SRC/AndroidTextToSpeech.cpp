@@ -38,7 +38,7 @@
   }
 
   bool AndroidTextToSpeech::Uninitialize() {
-        ReleaseAllStrings();
+        m_strings.Clear();
         if (env && speechObj) {
                 jmethodID midShutdown = env->GetMethodID(speechClass, "shutdown", "()V");
                 if (midShutdown) env->CallVoidMethod(speechObj, midShutdown);
@@ -1,37 +1,43 @@
 #include "Encoding.h"
-#include <vector>
+#include <string.h>
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
-bool UnicodeConvert(const std::string& input, std::wstring& output) {
+bool UnicodeConvert(const char* input, std::wstring& output) {
 #ifdef _WIN32
-	int size_needed = MultiByteToWideChar(CP_UTF8, 0, input.c_str(), -1, NULL, 0);
+	int size_needed = MultiByteToWideChar(CP_UTF8, 0, input, -1, NULL, 0);
 	if (size_needed == 0) {
 		return false;
 	}
-	std::vector<wchar_t> wide_string(size_needed);
-	if (MultiByteToWideChar(CP_UTF8, 0, input.c_str(), -1, &wide_string[0], size_needed) == 0) {
+	output.resize(size_needed);
+	if (MultiByteToWideChar(CP_UTF8, 0, input, -1, &output[0], size_needed) == 0) {
+		output.clear();
 		return false;
 	}
-	output.assign(wide_string.begin(), wide_string.end() - 1); // Remove null terminator
+	output.resize(size_needed - 1); // Remove null terminator
 	return true;
 #else
 	return false;
 #endif
 }
 
+bool UnicodeConvert(const std::string& input, std::wstring& output) {
+	return UnicodeConvert(input.c_str(), output);
+}
+
 bool UnicodeConvert(const std::wstring& input, std::string& output) {
 #ifdef _WIN32
 	int size_needed = WideCharToMultiByte(CP_UTF8, 0, input.c_str(), -1, NULL, 0, NULL, NULL);
 	if (size_needed == 0) {
 		return false;
 	}
-	std::vector<char> multi_byte_string(size_needed);
-	if (WideCharToMultiByte(CP_UTF8, 0, input.c_str(), -1, &multi_byte_string[0], size_needed, NULL, NULL) == 0) {
+	output.resize(size_needed);
+	if (WideCharToMultiByte(CP_UTF8, 0, input.c_str(), -1, &output[0], size_needed, NULL, NULL) == 0) {
+		output.clear();
 		return false;
 	}
-	output.assign(multi_byte_string.begin(), multi_byte_string.end() - 1); // Remove null terminator
+	output.resize(size_needed - 1); // Remove null terminator
 	return true;
 #else
 	return false;
@@ -42,31 +48,36 @@ bool UnicodeConvert(const std::wstring& input, std::string& output) {
 
 void XmlEncode(std::string& data) {
 	std::string encoded;
-	encoded.reserve(data.size()); // Reserve space for efficiency
+	XmlEncode(data.c_str(), encoded);
+	data = std::move(encoded); // Update the original string with the encoded version
+}
+
+void XmlEncode(const char* text, std::string& output) {
+	const size_t length = strlen(text);
+	output.reserve(output.size() + length); // Reserve space for efficiency
 
-	for (char c : data) {
+	for (const char* p = text; p != text + length; ++p) {
+		const char c = *p;
 		switch (c) {
 		case '&':
-			encoded += "&amp;";
+			output += "&amp;";
 			break;
 		case '<':
-			encoded += "&lt;";
+			output += "&lt;";
 			break;
 		case '>':
-			encoded += "&gt;";
+			output += "&gt;";
 			break;
 		case '"':
-			encoded += "&quot;";
+			output += "&quot;";
 			break;
 		case '\'':
-			encoded += "&apos;";
+			output += "&apos;";
 			break;
 		default:
-			encoded += c; // Copy the character as is
+			output += c; // Copy the character as is
 			break;
 		}
 	}
-
-	data = encoded; // Update the original string with the encoded version
 }
 
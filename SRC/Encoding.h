@@ -2,7 +2,11 @@
 #define ENCODING_H_
 #pragma once
 #include <string>
+// The conversions reuse the capacity output already has, so converting into a string kept across calls does not allocate.
+bool UnicodeConvert(const char* input, std::wstring& output);
 bool UnicodeConvert(const std::string& input, std::wstring& output);
 bool UnicodeConvert(const std::wstring& input, std::string& output);
 void XmlEncode(std::string& data);
+// Appends the encoded text to output instead of encoding a copy.
+void XmlEncode(const char* text, std::string& output);
 #endif // ENCODING_H
\ No newline at end of file
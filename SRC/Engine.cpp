@@ -3,11 +3,96 @@
 #include <cstddef>
 
 namespace Sral {
+	std::atomic<int> g_activeEngines{SRAL_ENGINE_NONE};
+	std::atomic<void (*)(const char* mark)> g_markReached{nullptr};
+	std::atomic<bool> g_pumpMode{false};
+
+	int ParameterType(int param) {
+		switch (param) {
+		case SRAL_PARAM_SPEECH_RATE:
+		case SRAL_PARAM_SPEECH_VOLUME:
+		case SRAL_PARAM_VOICE_INDEX:
+		case SRAL_PARAM_VOICE_COUNT:
+		case SRAL_PARAM_SYMBOL_LEVEL:
+		case SRAL_PARAM_SAPI_TRIM_THRESHOLD:
+			return SRAL_PARAM_TYPE_INT;
+		case SRAL_PARAM_ENABLE_SPELLING:
+		case SRAL_PARAM_USE_CHARACTER_DESCRIPTIONS:
+		case SRAL_PARAM_NVDA_IS_CONTROL_EX:
+			return SRAL_PARAM_TYPE_BOOL;
+		default:
+			return SRAL_PARAM_TYPE_NONE;
+		}
+	}
+
+	bool ParameterShadow::Shadowed(int param) {
+		switch (param) {
+		case SRAL_PARAM_SPEECH_RATE:
+		case SRAL_PARAM_SPEECH_VOLUME:
+		case SRAL_PARAM_VOICE_INDEX:
+		case SRAL_PARAM_SYMBOL_LEVEL:
+		case SRAL_PARAM_SAPI_TRIM_THRESHOLD:
+		case SRAL_PARAM_ENABLE_SPELLING:
+		case SRAL_PARAM_USE_CHARACTER_DESCRIPTIONS:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	int32_t ParameterShadow::Read(int param, const void* value) {
+		if (param == SRAL_PARAM_ENABLE_SPELLING || param == SRAL_PARAM_USE_CHARACTER_DESCRIPTIONS)
+			return *reinterpret_cast<const bool*>(value) ? 1 : 0;
+		return *reinterpret_cast<const int*>(value);
+	}
+
+	bool ParameterShadow::Get(int param, void* value) {
+		if (!Shadowed(param) || value == nullptr) return false;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!(m_valid & (1u << param))) return false;
+		if (param == SRAL_PARAM_ENABLE_SPELLING || param == SRAL_PARAM_USE_CHARACTER_DESCRIPTIONS)
+			*reinterpret_cast<bool*>(value) = m_values[param] != 0;
+		else
+			*reinterpret_cast<int*>(value) = m_values[param];
+		return true;
+	}
+
+	bool ParameterShadow::Matches(int param, const void* value) {
+		if (!Shadowed(param) || value == nullptr) return false;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return (m_valid & (1u << param)) && m_values[param] == Read(param, value);
+	}
+
+	void ParameterShadow::Set(int param, const void* value) {
+		if (!Shadowed(param) || value == nullptr) return;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (param == SRAL_PARAM_VOICE_INDEX) m_valid = 0;
+		m_values[param] = Read(param, value);
+		m_valid |= 1u << param;
+	}
+
+	void ParameterShadow::Store(int param, const void* value) {
+		if (!Shadowed(param) || value == nullptr) return;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_values[param] = Read(param, value);
+		m_valid |= 1u << param;
+	}
+
+	void ParameterShadow::Invalidate(int param) {
+		if (!Shadowed(param)) return;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_valid &= ~(1u << param);
+	}
+
+	void ParameterShadow::Invalidate() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_valid = 0;
+	}
+
 	Engine::Engine() {
 
 	}
 	Engine::~Engine() {
-		ReleaseAllStrings();
 		Uninitialize();
 	}
 
@@ -16,10 +101,61 @@ namespace Sral {
 		return false;
 	}
 
+	bool Engine::SpeakWithParams(const char* text, bool interrupt, const SRAL_UtteranceParams& params) {
+		struct Override {
+			int flag;
+			int param;
+			int value;
+			int saved;
+			bool known; // Whether saved holds the value from before the utterance.
+			bool set;
+		};
+		// The voice goes first, since switching it may reset the rate and volume on some engines;
+		// after a switch the other values are applied even if they match what was there before,
+		// including the ones the shadow holds that were not overridden.
+		Override overrides[] = {
+			{ SRAL_UTTERANCE_VOICE, SRAL_PARAM_VOICE_INDEX, params.voice_index, 0, false, false },
+			{ SRAL_UTTERANCE_RATE, SRAL_PARAM_SPEECH_RATE, params.rate, 0, false, false },
+			{ SRAL_UTTERANCE_VOLUME, SRAL_PARAM_SPEECH_VOLUME, params.volume, 0, false, false },
+		};
+		// Read before anything changes, so that a voice switch cannot affect the saved values.
+		for (Override& o : overrides) {
+			o.known = shadow.Get(o.param, &o.saved) || ((params.flags & o.flag) && GetParameter(o.param, &o.saved));
+		}
+		bool voiceChanged = false;
+		for (Override& o : overrides) {
+			const bool overridden = (params.flags & o.flag) != 0;
+			if (!o.known || (!overridden && !voiceChanged)) continue;
+			const int value = overridden ? o.value : o.saved;
+			if (value == o.saved && !voiceChanged) continue;
+			o.set = SetParameter(o.param, &value);
+			if (o.param == SRAL_PARAM_VOICE_INDEX) voiceChanged = o.set;
+		}
+		const bool result = Speak(text, interrupt);
+		// Restored in the same order: the voice first, then the rate and volume over whatever switching it back reset.
+		bool voiceRestored = false;
+		for (Override& o : overrides) {
+			if (!o.known || !(o.set || voiceRestored)) continue;
+			SetParameter(o.param, &o.saved);
+			if (o.param == SRAL_PARAM_VOICE_INDEX) voiceRestored = true;
+		}
+		return result;
+	}
+
 	bool Engine::GetActive() {
 		return false;
 	}
 
+	void Engine::PublishActive(bool active) {
+		const int engine = GetNumber();
+		// Probes mostly confirm the current state, so avoid writing the shared mask when nothing changed.
+		if (((g_activeEngines.load(std::memory_order_relaxed) & engine) != 0) == active) return;
+		if (active)
+			g_activeEngines.fetch_or(engine);
+		else
+			g_activeEngines.fetch_and(~engine);
+	}
+
 	int Engine::GetFeatures() {
 		return 0;
 	}
@@ -46,6 +182,20 @@ namespace Sral {
 		return false;
 	}
 
+	void Engine::SetParameters(const SRAL_ParamValue* values, size_t count, bool* results) {
+		for (int pass = 0; pass < 2; ++pass) {
+			for (size_t i = 0; i < count; ++i) {
+				if ((values[i].param == SRAL_PARAM_VOICE_INDEX) != (pass == 0)) continue;
+				const void* value = values[i].type == SRAL_PARAM_TYPE_BOOL ? static_cast<const void*>(&values[i].value.bool_value) : &values[i].value.int_value;
+				results[i] = SetParameter(values[i].param, value);
+			}
+		}
+	}
+
+	void Engine::Pump(uint64_t now) {
+		(void)now;
+	}
+
 	bool Engine::PauseSpeech() {
 		return false;
 	}
@@ -1,7 +1,15 @@
 #ifndef ENGINE_H_
 #define ENGINE_H_
 #pragma once
+#include "../Include/SRAL.h"
+#include "Latency.h"
+#include "StringPool.h"
 #include <stdint.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <vector>
 #include <string.h>
 
@@ -13,12 +21,47 @@ namespace Sral {
 		HANDLE_PAUSE_RESUME = 4
 	};
 
+	// The SRAL_ParamType of a parameter's value, or SRAL_PARAM_TYPE_NONE for parameters that are not plain values.
+	int ParameterType(int param);
+
+	// The last value of each scalar parameter set or read through SRAL_SetEngineParameter and SRAL_GetEngineParameter,
+	// so that setting the same value again does not reach the engine and reading it needs no round trip to it.
+	// Engines call Invalidate() when their settings may have changed on their own, for example after a reconnect.
+	class ParameterShadow {
+	public:
+		// Whether param is an int or bool parameter that is shadowed.
+		static bool Shadowed(int param);
+
+		// Copies the shadowed value of param to value if there is one.
+		bool Get(int param, void* value);
+		// Whether value is the shadowed value of param.
+		bool Matches(int param, const void* value);
+		// Records a value that was set. A new voice may come with its own rate and volume, so setting the voice forgets the rest.
+		void Set(int param, const void* value);
+		// Records a value that was read.
+		void Store(int param, const void* value);
+		void Invalidate(int param);
+		void Invalidate();
+
+	private:
+		static constexpr int kCount = SRAL_PARAM_USE_CHARACTER_DESCRIPTIONS + 1;
+
+		static int32_t Read(int param, const void* value);
+
+		std::mutex m_mutex;
+		std::array<int32_t, kCount> m_values{};
+		uint32_t m_valid{0}; // One bit per parameter.
+	};
+
 	class Engine {
 	public:
 		Engine();
 		virtual ~Engine();
 		virtual bool Speak(const char* text, bool interrupt);
 		virtual bool SpeakSsml(const char* ssml, bool interrupt);
+		// Speaks text with the parameters in params overriding the engine's for this message only.
+		// By default they are set around Speak and restored afterwards; engines that can express them in markup override it.
+		virtual bool SpeakWithParams(const char* text, bool interrupt, const SRAL_UtteranceParams& params);
 		virtual void* SpeakToMemory(const char* text, uint64_t* buffer_size, int* channels, int* sample_rate, int* bits_per_sample);
 		virtual bool Braille(const char* text);
 		virtual bool StopSpeech();
@@ -33,27 +76,42 @@ namespace Sral {
 		virtual int GetKeyFlags();
 		virtual bool SetParameter(int param, const void* value);
 		virtual bool GetParameter(int param, void* value);
+		// Sets values[i] and reports in results[i] whether it was applied, voice first.
+		// The values' types have already been checked against ParameterType().
+		virtual void SetParameters(const SRAL_ParamValue* values, size_t count, bool* results);
+		// Does the background work the engine would otherwise do on a thread of its own; see g_pumpMode.
+		// now is LatencyTracker::Now().
+		virtual void Pump(uint64_t now);
+
+		// Records whether the engine is active in g_activeEngines.
+		void PublishActive(bool active);
 
 		bool paused;
+		LatencyTracker latency;
+		ParameterShadow shadow;
+		// Outermost middleware wrapping this engine, or nullptr to call the engine directly.
+		std::atomic<Engine*> pipeline{nullptr};
+		// Held shared by calls going through the chain and exclusively while it is changed, so that no middleware
+		// is destroyed while a call is still in it.
+		std::shared_mutex pipelineMutex;
 	protected:
-		std::vector<char*> m_strings;
-
-		inline const char* AddString(const char* str) {
-			if (!str) return nullptr;
-
-			size_t len = strlen(str) + 1;
-			char* cString = new char[len];
-			strcpy(cString, str);
-			m_strings.push_back(cString);
-			return cString;
-		}
-
-		inline void ReleaseAllStrings() {
-			for (auto str : m_strings) {
-				delete[] str;
-			}
-			m_strings.clear();
-		}
+		// Strings returned to callers (voice names and the like). Cleared when the engine is uninitialized.
+		StringPool m_strings;
 	};
+
+	// Engines whose most recently observed GetActive() was true. Engines that notice a change on their own,
+	// such as a dropped connection, publish it right away; the rest are refreshed whenever they are probed.
+	extern std::atomic<int> g_activeEngines;
+
+	// Engines that report SSML marks pass their names here while someone is listening for them.
+	extern std::atomic<void (*)(const char* mark)> g_markReached;
+
+	// Set by SRAL_InitializeEx with SRAL_INIT_PUMP before any engine is created. Engines and middleware then start
+	// no threads of their own and leave their periodic work to Pump(), which SRAL_Pump calls.
+	extern std::atomic<bool> g_pumpMode;
+
+	// Registers an already constructed engine under its GetNumber(), replacing the built-in one.
+	// Meant for tools that drive SRAL with a substitute backend (sral-replay); not part of the public API.
+	bool InstallEngine(std::unique_ptr<Engine> engine);
 }
 #endif
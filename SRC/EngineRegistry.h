@@ -0,0 +1,134 @@
+#ifndef ENGINEREGISTRY_H_
+#define ENGINEREGISTRY_H_
+#pragma once
+#include "../Include/SRAL.h"
+#include "Engine.h"
+#include "Middleware.h"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+namespace Sral {
+
+	// Owns the engines in a fixed array indexed by the bit position of their SRAL_Engines value.
+	// Lookups are an index instead of a tree search, and the mask of available engines is kept up to date
+	// so that it can be read without walking the engines. Iteration goes in ascending engine order.
+	class EngineRegistry {
+	public:
+		static constexpr int kSlots = 32;
+
+		class Iterator {
+		public:
+			Iterator(const EngineRegistry* registry, int mask) : m_registry(registry), m_mask(mask) {}
+			std::pair<SRAL_Engines, Engine*> operator*() const {
+				const int value = m_mask & -m_mask;
+				return { static_cast<SRAL_Engines>(value), m_registry->m_engines[Slot(value)].get() };
+			}
+			Iterator& operator++() {
+				m_mask &= m_mask - 1;
+				return *this;
+			}
+			bool operator!=(const Iterator& other) const {
+				return m_mask != other.m_mask;
+			}
+		private:
+			const EngineRegistry* m_registry;
+			int m_mask;
+		};
+
+		static int Slot(int engine) {
+			return std::countr_zero(static_cast<unsigned int>(engine));
+		}
+
+		// Whether engine is a single SRAL_Engines bit, the only values that have a slot.
+		static bool Valid(int engine) {
+			return engine > 0 && (engine & (engine - 1)) == 0;
+		}
+
+		// engine must be a single SRAL_Engines bit, anything else finds nothing.
+		Engine* Get(int engine) const {
+			if (!Valid(engine)) return nullptr;
+			return m_engines[Slot(engine)].get();
+		}
+
+		// Replaces the engine in the slot, destroying the previous one. Returns false if value is not a single engine bit.
+		bool Set(SRAL_Engines value, std::unique_ptr<Engine> engine) {
+			if (!Valid(value)) return false;
+			ClearMiddleware(value);
+			const bool present = engine != nullptr;
+			m_engines[Slot(value)] = std::move(engine);
+			if (present)
+				m_available.fetch_or(value, std::memory_order_release);
+			else
+				m_available.fetch_and(~value, std::memory_order_release);
+			return true;
+		}
+
+		void Clear() {
+			m_available.store(SRAL_ENGINE_NONE, std::memory_order_release);
+			for (int slot = 0; slot < kSlots; ++slot) {
+				ClearMiddleware(static_cast<SRAL_Engines>(1 << slot));
+			}
+			for (auto& engine : m_engines) {
+				engine.reset();
+			}
+		}
+
+		// Wraps the engine's current chain in another middleware, which then sees calls first.
+		bool AddMiddleware(SRAL_Engines value, std::unique_ptr<Middleware> middleware) {
+			Engine* engine = Get(value);
+			if (engine == nullptr || middleware == nullptr) return false;
+			std::unique_lock<std::shared_mutex> lock(engine->pipelineMutex);
+			Engine* pipeline = engine->pipeline.load(std::memory_order_relaxed);
+			middleware->SetNext(pipeline ? pipeline : engine);
+			Middleware* outermost = middleware.get();
+			m_middleware[Slot(value)].push_back(std::move(middleware));
+			engine->pipeline.store(outermost, std::memory_order_release);
+			return true;
+		}
+
+		// Unhooks the chain once no call is in it, then destroys it from the outermost middleware in, since a
+		// middleware may still call the next one from a thread of its own until it is destroyed.
+		void ClearMiddleware(SRAL_Engines value) {
+			if (!Valid(value)) return;
+			std::vector<std::unique_ptr<Middleware>> chain;
+			{
+				Engine* engine = Get(value);
+				std::unique_lock<std::shared_mutex> lock;
+				if (engine != nullptr) {
+					lock = std::unique_lock<std::shared_mutex>(engine->pipelineMutex);
+					engine->pipeline.store(nullptr, std::memory_order_release);
+				}
+				chain.swap(m_middleware[Slot(value)]);
+			}
+			while (!chain.empty()) chain.pop_back();
+		}
+
+		int Available() const {
+			return m_available.load(std::memory_order_acquire);
+		}
+
+		bool Empty() const {
+			return Available() == SRAL_ENGINE_NONE;
+		}
+
+		Iterator begin() const {
+			return Iterator(this, Available());
+		}
+
+		Iterator end() const {
+			return Iterator(this, SRAL_ENGINE_NONE);
+		}
+
+	private:
+		std::array<std::unique_ptr<Engine>, kSlots> m_engines;
+		std::array<std::vector<std::unique_ptr<Middleware>>, kSlots> m_middleware;
+		std::atomic<int> m_available{SRAL_ENGINE_NONE};
+	};
+}
+#endif
@@ -0,0 +1,178 @@
+#include "Latency.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+
+namespace Sral {
+	int LatencyHistogram::BucketIndex(uint64_t us) {
+		if (us < kSubBuckets) return static_cast<int>(us);
+		const int octave = static_cast<int>(std::bit_width(us)) - 1;
+		const int sub = static_cast<int>((us >> (octave - 3)) & (kSubBuckets - 1));
+		return kSubBuckets + (octave - 3) * kSubBuckets + sub;
+	}
+
+	uint64_t LatencyHistogram::BucketValue(int index) {
+		if (index < kSubBuckets) return static_cast<uint64_t>(index);
+		const int octave = (index - kSubBuckets) / kSubBuckets + 3;
+		const uint64_t sub = static_cast<uint64_t>((index - kSubBuckets) % kSubBuckets);
+		const uint64_t width = uint64_t(1) << (octave - 3);
+		// Report the middle of the bucket.
+		return (kSubBuckets + sub) * width + width / 2;
+	}
+
+	void LatencyHistogram::Add(uint64_t us) {
+		m_buckets[BucketIndex(us)]++;
+		m_count++;
+		m_sum += us;
+		if (us < m_min) m_min = us;
+		if (us > m_max) m_max = us;
+	}
+
+	void LatencyHistogram::Merge(const LatencyHistogram& other) {
+		for (int i = 0; i < kBuckets; ++i) {
+			m_buckets[i] += other.m_buckets[i];
+		}
+		m_count += other.m_count;
+		m_sum += other.m_sum;
+		if (other.m_min < m_min) m_min = other.m_min;
+		if (other.m_max > m_max) m_max = other.m_max;
+	}
+
+	void LatencyHistogram::Export(SRAL_LatencyDistribution* out) const {
+		*out = SRAL_LatencyDistribution{};
+		out->count = m_count;
+		if (m_count == 0) return;
+		out->min_us = m_min;
+		out->max_us = m_max;
+		out->mean_us = m_sum / m_count;
+
+		const uint64_t p50 = (m_count * 50 + 99) / 100;
+		const uint64_t p90 = (m_count * 90 + 99) / 100;
+		const uint64_t p99 = (m_count * 99 + 99) / 100;
+		uint64_t seen = 0;
+		for (int i = 0; i < kBuckets; ++i) {
+			if (m_buckets[i] == 0) continue;
+			seen += m_buckets[i];
+			const uint64_t value = BucketValue(i);
+			if (out->p50_us == 0 && seen >= p50) out->p50_us = value;
+			if (out->p90_us == 0 && seen >= p90) out->p90_us = value;
+			if (out->p99_us == 0 && seen >= p99) {
+				out->p99_us = value;
+				break;
+			}
+		}
+		// Bucket midpoints may fall outside of what was actually observed.
+		auto clamp = [&](uint64_t& v) {
+			if (v < m_min) v = m_min;
+			if (v > m_max) v = m_max;
+		};
+		clamp(out->p50_us);
+		clamp(out->p90_us);
+		clamp(out->p99_us);
+	}
+
+	void LatencyHistogram::Reset() {
+		*this = LatencyHistogram();
+	}
+
+
+
+	uint64_t LatencyTracker::Now() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void LatencyTracker::AddSubmitToBegin(uint64_t us) {
+		m_submitToBegin.Add(us);
+		if (m_recentSubmitToBegin == 0) m_recentSubmitToBegin = static_cast<double>(us);
+		else m_recentSubmitToBegin += kSmoothing * (static_cast<double>(us) - m_recentSubmitToBegin);
+	}
+
+	LatencyTracker::Pending& LatencyTracker::Slot(uint64_t id) {
+		Pending& p = m_pending[id % kPendingSlots];
+		if (!p.used || p.id != id) p = Pending{id, 0, 0, true};
+		return p;
+	}
+
+	LatencyTracker::Pending* LatencyTracker::Find(uint64_t id) {
+		Pending& p = m_pending[id % kPendingSlots];
+		return p.used && p.id == id ? &p : nullptr;
+	}
+
+	void LatencyTracker::Submitted(uint64_t id, uint64_t time) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Pending& p = Slot(id);
+		p.submitted = time;
+		// The begin event has already been delivered.
+		if (p.began != 0) {
+			AddSubmitToBegin(p.began > time ? p.began - time : 0);
+		}
+	}
+
+	void LatencyTracker::Began(uint64_t id) {
+		const uint64_t now = Now();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Pending& p = Slot(id);
+		p.began = now;
+		if (p.submitted != 0) {
+			AddSubmitToBegin(now > p.submitted ? now - p.submitted : 0);
+		}
+	}
+
+	void LatencyTracker::Ended(uint64_t id) {
+		const uint64_t now = Now();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Pending* p = Find(id);
+		if (p == nullptr) return;
+		if (p->began != 0) {
+			m_beginToEnd.Add(now > p->began ? now - p->began : 0);
+		}
+		*p = Pending();
+	}
+
+	void LatencyTracker::Cancelled(uint64_t id) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (Pending* p = Find(id)) *p = Pending();
+	}
+
+	void LatencyTracker::CallFinished(uint64_t us, bool success) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_calls++ == 0) {
+			m_callTime = static_cast<double>(us);
+			m_successRate = success ? 1.0 : 0.0;
+			return;
+		}
+		m_callTime += kSmoothing * (static_cast<double>(us) - m_callTime);
+		m_successRate += kSmoothing * ((success ? 1.0 : 0.0) - m_successRate);
+	}
+
+	void LatencyTracker::Export(SRAL_EngineStats* out) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		out->calls = m_calls;
+		out->call_us = static_cast<uint64_t>(m_callTime);
+		out->submit_to_begin_us = static_cast<uint64_t>(m_recentSubmitToBegin);
+		out->success_rate = m_successRate;
+	}
+
+	double LatencyTracker::Score() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_calls == 0) return 0;
+		return (m_callTime + m_recentSubmitToBegin) / std::max(m_successRate, 0.01);
+	}
+
+	void LatencyTracker::Export(SRAL_LatencyStats* out) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_submitToBegin.Export(&out->submit_to_begin);
+		m_beginToEnd.Export(&out->begin_to_end);
+	}
+
+	void LatencyTracker::Reset() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending.fill(Pending());
+		m_submitToBegin.Reset();
+		m_beginToEnd.Reset();
+		m_calls = 0;
+		m_callTime = 0;
+		m_successRate = 1;
+		m_recentSubmitToBegin = 0;
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+#pragma once
+#include "../Include/SRAL.h"
+#include <stdint.h>
+#include <array>
+#include <mutex>
+
+namespace Sral {
+
+	// Log-linear histogram of durations in microseconds:
+	// 8 sub-buckets per power of two, so percentiles are within ~12%.
+	class LatencyHistogram {
+	public:
+		void Add(uint64_t us);
+		void Merge(const LatencyHistogram& other);
+		void Export(SRAL_LatencyDistribution* out) const;
+		void Reset();
+
+	private:
+		static constexpr int kSubBuckets = 8;
+		static constexpr int kBuckets = kSubBuckets + 61 * kSubBuckets;
+		static int BucketIndex(uint64_t us);
+		static uint64_t BucketValue(int index);
+
+		uint64_t m_buckets[kBuckets]{};
+		uint64_t m_count{0};
+		uint64_t m_sum{0};
+		uint64_t m_min{UINT64_MAX};
+		uint64_t m_max{0};
+	};
+
+	// Correlates the moment an utterance is handed to an engine with the
+	// begin/end events the engine reports for it. Events may arrive in any
+	// order relative to Submitted(), since some engines notify from their own thread.
+	// Also keeps rolling averages of the engine's speak calls, which adaptive engine selection ranks by.
+	class LatencyTracker {
+	public:
+		static uint64_t Now();
+
+		void Submitted(uint64_t id, uint64_t time);
+		void Began(uint64_t id);
+		void Ended(uint64_t id);
+		void Cancelled(uint64_t id);
+		void CallFinished(uint64_t us, bool success);
+
+		void Export(SRAL_LatencyStats* out);
+		void Export(SRAL_EngineStats* out);
+		// Expected microseconds until speech starts, penalized by the failure rate. Lower is better,
+		// and an engine without samples scores 0 so that it gets tried.
+		double Score();
+		void Reset();
+
+	private:
+		struct Pending {
+			uint64_t id{0};
+			uint64_t submitted{0};
+			uint64_t began{0};
+			bool used{false};
+		};
+		// Pending utterances live in a fixed table indexed by id, so that tracking one never allocates.
+		// An utterance takes over the slot of an older one that shares it; with sequential ids that only happens
+		// once this many are outstanding, as with engines that never report an end event for an utterance.
+		static constexpr size_t kPendingSlots = 1024;
+		Pending& Slot(uint64_t id);
+		Pending* Find(uint64_t id);
+		// Weight of the newest sample in the rolling averages.
+		static constexpr double kSmoothing = 0.2;
+		void AddSubmitToBegin(uint64_t us);
+
+		std::mutex m_mutex;
+		std::array<Pending, kPendingSlots> m_pending{};
+		LatencyHistogram m_submitToBegin;
+		LatencyHistogram m_beginToEnd;
+		uint64_t m_calls{0};
+		double m_callTime{0};
+		double m_successRate{1};
+		double m_recentSubmitToBegin{0};
+	};
+}
+#endif
@@ -0,0 +1,299 @@
+#include "Middleware.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+
+namespace Sral {
+	bool Middleware::Speak(const char* text, bool interrupt) {
+		return m_next->Speak(text, interrupt);
+	}
+
+	bool Middleware::SpeakSsml(const char* ssml, bool interrupt) {
+		return m_next->SpeakSsml(ssml, interrupt);
+	}
+
+	bool Middleware::SpeakWithParams(const char* text, bool interrupt, const SRAL_UtteranceParams& params) {
+		return m_next->SpeakWithParams(text, interrupt, params);
+	}
+
+	void* Middleware::SpeakToMemory(const char* text, uint64_t* buffer_size, int* channels, int* sample_rate, int* bits_per_sample) {
+		return m_next->SpeakToMemory(text, buffer_size, channels, sample_rate, bits_per_sample);
+	}
+
+	bool Middleware::Braille(const char* text) {
+		return m_next->Braille(text);
+	}
+
+	bool Middleware::StopSpeech() {
+		return m_next->StopSpeech();
+	}
+
+	bool Middleware::PauseSpeech() {
+		return m_next->PauseSpeech();
+	}
+
+	bool Middleware::ResumeSpeech() {
+		return m_next->ResumeSpeech();
+	}
+
+	bool Middleware::IsSpeaking() {
+		return m_next->IsSpeaking();
+	}
+
+	int Middleware::GetNumber() {
+		return m_next->GetNumber();
+	}
+
+	bool Middleware::GetActive() {
+		return m_next->GetActive();
+	}
+
+	int Middleware::GetFeatures() {
+		return m_next->GetFeatures();
+	}
+
+	int Middleware::GetKeyFlags() {
+		return m_next->GetKeyFlags();
+	}
+
+	bool Middleware::SetParameter(int param, const void* value) {
+		return m_next->SetParameter(param, value);
+	}
+
+	bool Middleware::GetParameter(int param, void* value) {
+		return m_next->GetParameter(param, value);
+	}
+
+	void Middleware::SetParameters(const SRAL_ParamValue* values, size_t count, bool* results) {
+		m_next->SetParameters(values, count, results);
+	}
+
+	void Middleware::Pump(uint64_t now) {
+		m_next->Pump(now);
+	}
+
+
+
+	bool TextFilter::Speak(const char* text, bool interrupt) {
+		const char* filtered = m_filter(text, m_userData);
+		// Dropping a message on purpose is not a failure.
+		if (filtered == nullptr) return true;
+		return m_next->Speak(filtered, interrupt);
+	}
+
+	bool TextFilter::SpeakWithParams(const char* text, bool interrupt, const SRAL_UtteranceParams& params) {
+		const char* filtered = m_filter(text, m_userData);
+		if (filtered == nullptr) return true;
+		return m_next->SpeakWithParams(filtered, interrupt, params);
+	}
+
+	void* TextFilter::SpeakToMemory(const char* text, uint64_t* buffer_size, int* channels, int* sample_rate, int* bits_per_sample) {
+		const char* filtered = m_filter(text, m_userData);
+		if (filtered == nullptr) return nullptr;
+		return m_next->SpeakToMemory(filtered, buffer_size, channels, sample_rate, bits_per_sample);
+	}
+
+	bool TextFilter::Braille(const char* text) {
+		const char* filtered = m_filter(text, m_userData);
+		if (filtered == nullptr) return true;
+		return m_next->Braille(filtered);
+	}
+
+
+
+	RateLimiter::RateLimiter(int perSecond, int burst) {
+		m_perSecond = static_cast<double>(std::max(perSecond, 1));
+		m_burst = static_cast<double>(std::max(burst, 1));
+		m_tokens = m_burst;
+		m_lastRefill = LatencyTracker::Now();
+	}
+
+	bool RateLimiter::Admit(bool interrupt) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const uint64_t now = LatencyTracker::Now();
+		m_tokens = std::min(m_burst, m_tokens + static_cast<double>(now - m_lastRefill) * m_perSecond / 1000000.0);
+		m_lastRefill = now;
+		if (m_tokens >= 1.0) {
+			m_tokens -= 1.0;
+			return true;
+		}
+		return interrupt;
+	}
+
+	bool RateLimiter::Speak(const char* text, bool interrupt) {
+		if (!Admit(interrupt)) return true;
+		return m_next->Speak(text, interrupt);
+	}
+
+	bool RateLimiter::SpeakSsml(const char* ssml, bool interrupt) {
+		if (!Admit(interrupt)) return true;
+		return m_next->SpeakSsml(ssml, interrupt);
+	}
+
+	bool RateLimiter::SpeakWithParams(const char* text, bool interrupt, const SRAL_UtteranceParams& params) {
+		if (!Admit(interrupt)) return true;
+		return m_next->SpeakWithParams(text, interrupt, params);
+	}
+
+
+
+	Coalescer::Coalescer(int windowMs) : m_window(static_cast<uint64_t>(std::max(windowMs, 1)) * 1000) {
+		m_held.reserve(kMaxHeld);
+		if (!g_pumpMode.load()) m_thread = std::thread(&Coalescer::FlushThread, this);
+	}
+
+	Coalescer::~Coalescer() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_cv.notify_one();
+		if (m_thread.joinable()) m_thread.join();
+	}
+
+	uint64_t Coalescer::Hash(const char* text) {
+		// FNV-1a
+		uint64_t hash = 14695981039346656037ull;
+		for (; *text; ++text) {
+			hash = (hash ^ static_cast<unsigned char>(*text)) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	uint64_t Coalescer::Key(const char* text) {
+		// Like Hash, with every run of digits (and the separators inside a number) folded into one '#'.
+		uint64_t hash = 14695981039346656037ull;
+		bool inNumber = false;
+		for (; *text; ++text) {
+			const char c = *text;
+			const bool digit = c >= '0' && c <= '9';
+			if (digit || (inNumber && (c == '.' || c == ',') && text[1] >= '0' && text[1] <= '9')) {
+				if (!inNumber) hash = (hash ^ '#') * 1099511628211ull;
+				inNumber = true;
+				continue;
+			}
+			inNumber = false;
+			hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// Returns an entry spoken within the window with the same text or, failing that, the same key.
+	const Coalescer::Recent* Coalescer::FindRecent(uint64_t hash, uint64_t key, uint64_t now) const {
+		const Recent* sameKey = nullptr;
+		for (const Recent& recent : m_recent) {
+			if (recent.time == 0 || now - recent.time >= m_window) continue;
+			if (recent.hash == hash) return &recent;
+			if (recent.key == key && (sameKey == nullptr || recent.time > sameKey->time)) sameKey = &recent;
+		}
+		return sameKey;
+	}
+
+	// Returns the newest entry spoken within the window with the given key.
+	const Coalescer::Recent* Coalescer::LastSpoken(uint64_t key, uint64_t now) const {
+		const Recent* last = nullptr;
+		for (const Recent& recent : m_recent) {
+			if (recent.time == 0 || now - recent.time >= m_window || recent.key != key) continue;
+			if (last == nullptr || recent.time > last->time) last = &recent;
+		}
+		return last;
+	}
+
+	void Coalescer::Remember(uint64_t hash, uint64_t key, uint64_t now) {
+		m_recent[m_recentNext] = { hash, key, now };
+		m_recentNext = (m_recentNext + 1) % kRecent;
+	}
+
+	bool Coalescer::Speak(const char* text, bool interrupt) {
+		const uint64_t now = LatencyTracker::Now();
+		const uint64_t hash = Hash(text);
+		const uint64_t key = Key(text);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			// A held message is looked at before duplicates, so that it never outlives a newer value.
+			auto held = std::find_if(m_held.begin(), m_held.end(), [key](const Held& h) { return h.key == key; });
+			if (held != m_held.end()) {
+				const Recent* last = LastSpoken(key, now);
+				if (last && last->hash == hash) {
+					// Back to what was spoken last, so the held change is no longer news.
+					SRAL_TRACE_INSTANT("coalesce", "reverted", 0);
+					m_held.erase(held);
+					return true;
+				}
+				SRAL_TRACE_INSTANT("coalesce", "replaced", 0);
+				held->text = text;
+				held->interrupt = held->interrupt || interrupt;
+				return true;
+			}
+			const Recent* recent = FindRecent(hash, key, now);
+			if (recent && recent->hash == hash) {
+				SRAL_TRACE_INSTANT("coalesce", "duplicate", 0);
+				return true;
+			}
+			if (recent && m_held.size() < kMaxHeld) {
+				SRAL_TRACE_INSTANT("coalesce", "held", 0);
+				m_held.push_back({ key, recent->time + m_window, interrupt, text });
+				m_cv.notify_one();
+				return true;
+			}
+			Remember(hash, key, now);
+		}
+		return m_next->Speak(text, interrupt);
+	}
+
+	bool Coalescer::StopSpeech() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_held.clear();
+		}
+		return m_next->StopSpeech();
+	}
+
+	uint64_t Coalescer::Flush(uint64_t now) {
+		std::vector<Held> due;
+		uint64_t next = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (auto it = m_held.begin(); it != m_held.end();) {
+				if (it->due <= now) {
+					Remember(Hash(it->text.c_str()), it->key, now);
+					due.push_back(std::move(*it));
+					it = m_held.erase(it);
+				}
+				else {
+					if (next == 0 || it->due < next) next = it->due;
+					++it;
+				}
+			}
+		}
+		for (const Held& held : due) {
+			m_next->Speak(held.text.c_str(), held.interrupt);
+		}
+		return next;
+	}
+
+	void Coalescer::Pump(uint64_t now) {
+		Flush(now);
+		m_next->Pump(now);
+	}
+
+	void Coalescer::FlushThread() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_stop) {
+			if (m_held.empty()) {
+				m_cv.wait(lock);
+				continue;
+			}
+			uint64_t due = m_held.front().due;
+			for (const Held& held : m_held) due = std::min(due, held.due);
+			const uint64_t now = LatencyTracker::Now();
+			if (due > now) {
+				m_cv.wait_for(lock, std::chrono::microseconds(due - now));
+				continue;
+			}
+			lock.unlock();
+			Flush(now);
+			lock.lock();
+		}
+	}
+}
@@ -0,0 +1,140 @@
+#ifndef MIDDLEWARE_H_
+#define MIDDLEWARE_H_
+#pragma once
+#include "../Include/SRAL.h"
+#include "Engine.h"
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Sral {
+
+	// A decorator around an engine. Every call is forwarded to the next engine in the chain (another
+	// middleware or the engine itself), so a middleware only overrides what it changes.
+	// Chains are built by EngineRegistry::AddMiddleware; engines without one are called directly.
+	class Middleware : public Engine {
+	public:
+		void SetNext(Engine* next) {
+			m_next = next;
+		}
+
+		bool Speak(const char* text, bool interrupt)override;
+		bool SpeakSsml(const char* ssml, bool interrupt)override;
+		bool SpeakWithParams(const char* text, bool interrupt, const SRAL_UtteranceParams& params)override;
+		void* SpeakToMemory(const char* text, uint64_t* buffer_size, int* channels, int* sample_rate, int* bits_per_sample)override;
+		bool Braille(const char* text)override;
+		bool StopSpeech()override;
+		bool PauseSpeech()override;
+		bool ResumeSpeech()override;
+		bool IsSpeaking()override;
+		int GetNumber()override;
+		bool GetActive()override;
+		int GetFeatures()override;
+		int GetKeyFlags()override;
+		bool SetParameter(int param, const void* value)override;
+		bool GetParameter(int param, void* value)override;
+		void SetParameters(const SRAL_ParamValue* values, size_t count, bool* results)override;
+		void Pump(uint64_t now)override;
+
+		// The wrapped engine owns its lifetime; a middleware has nothing to set up.
+		bool Initialize()override {
+			return true;
+		}
+		bool Uninitialize()override {
+			return true;
+		}
+
+	protected:
+		Engine* m_next = nullptr;
+	};
+
+	// Passes plain text (not SSML) through a user callback, which may rewrite it or drop it by returning NULL.
+	class TextFilter final : public Middleware {
+	public:
+		TextFilter(SRAL_TextFilter filter, void* userData) : m_filter(filter), m_userData(userData) {}
+
+		bool Speak(const char* text, bool interrupt)override;
+		bool SpeakWithParams(const char* text, bool interrupt, const SRAL_UtteranceParams& params)override;
+		void* SpeakToMemory(const char* text, uint64_t* buffer_size, int* channels, int* sample_rate, int* bits_per_sample)override;
+		bool Braille(const char* text)override;
+
+	private:
+		SRAL_TextFilter m_filter;
+		void* m_userData;
+	};
+
+	// Token bucket over utterances: at most `perSecond` on average with bursts of up to `burst`.
+	// Utterances over the limit are dropped unless they interrupt, since an interrupting message replaces
+	// whatever was being said anyway.
+	class RateLimiter final : public Middleware {
+	public:
+		RateLimiter(int perSecond, int burst);
+
+		bool Speak(const char* text, bool interrupt)override;
+		bool SpeakSsml(const char* ssml, bool interrupt)override;
+		bool SpeakWithParams(const char* text, bool interrupt, const SRAL_UtteranceParams& params)override;
+
+	private:
+		bool Admit(bool interrupt);
+
+		std::mutex m_mutex;
+		double m_perSecond;
+		double m_burst;
+		double m_tokens;
+		uint64_t m_lastRefill;
+	};
+
+	// Merges rapid-fire announcements within a time window:
+	// - a message identical to one spoken within the window is dropped;
+	// - messages that differ only in their numbers ("Health 50", "Health 45") share a key, and while one of
+	//   them was spoken within the window, the newest is held back and spoken when the window ends, replacing
+	//   any message still held for that key.
+	// The first message of a burst is never delayed. Messages with parameters of their own are passed through.
+	class Coalescer final : public Middleware {
+	public:
+		explicit Coalescer(int windowMs);
+		~Coalescer();
+
+		bool Speak(const char* text, bool interrupt)override;
+		bool StopSpeech()override;
+		void Pump(uint64_t now)override;
+
+		// Speaks the held messages that are due and returns when the next one will be, or 0 if none is held.
+		uint64_t Flush(uint64_t now);
+
+	private:
+		struct Recent {
+			uint64_t hash{0};
+			uint64_t key{0};
+			uint64_t time{0};
+		};
+		struct Held {
+			uint64_t key;
+			uint64_t due;
+			bool interrupt;
+			std::string text;
+		};
+		static constexpr size_t kRecent = 32;
+		static constexpr size_t kMaxHeld = 16;
+
+		static uint64_t Hash(const char* text);
+		static uint64_t Key(const char* text);
+		const Recent* FindRecent(uint64_t hash, uint64_t key, uint64_t now) const;
+		const Recent* LastSpoken(uint64_t key, uint64_t now) const;
+		void Remember(uint64_t hash, uint64_t key, uint64_t now);
+		void FlushThread();
+
+		const uint64_t m_window; // Microseconds.
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		std::array<Recent, kRecent> m_recent{};
+		size_t m_recentNext{0};
+		std::vector<Held> m_held;
+		bool m_stop{false};
+		std::thread m_thread;
+	};
+}
+#endif
@@ -57,15 +57,17 @@ namespace Sral {
 		}
 		if (this->extended)
 			return !enable_spelling ? nvda_speak(text, this->symbolLevel) == 0 : nvda_speak_spelling(text, "", this->use_character_descriptions) == 0;
-		std::wstring out;
+		// Built in buffers kept by the thread, so that speaking allocates nothing once they have grown.
+		thread_local std::string ssml;
+		thread_local std::wstring out;
 		if (this->symbolLevel == -1) {
 			UnicodeConvert(text, out);
 			return nvdaController_speakText(out.c_str()) == 0;
 		}
-		std::string text_str(text);
-		XmlEncode(text_str);
-		std::string final = "<speak>" + text_str + "</speak>";
-		UnicodeConvert(final, out);
+		ssml.assign("<speak>");
+		XmlEncode(text, ssml);
+		ssml.append("</speak>");
+		UnicodeConvert(ssml.c_str(), out);
 		error_status_t result = nvdaController_speakSsml(out.c_str(), this->symbolLevel, 0, true);
 		if (result == 1717) {
 			UnicodeConvert(text, out);
@@ -83,8 +85,7 @@ namespace Sral {
 			this->extended ? nvda_cancel_speech() : nvdaController_cancelSpeech();
 		if (this->extended)
 			return nvda_speak_ssml(ssml, this->symbolLevel) == 0;
-		std::string text_str(ssml);
-		std::wstring out;
+		thread_local std::wstring out;
 		UnicodeConvert(ssml, out);
 		return nvdaController_speakSsml(out.c_str(), this->symbolLevel, 0, true) == 0;
 	}
@@ -0,0 +1,128 @@
+#include "OutputQueue.h"
+
+namespace Sral {
+	uint32_t OutputQueue::Allocate() {
+		uint32_t index;
+		if (m_free != kNone) {
+			index = m_free;
+			m_free = m_slots[index].next;
+		}
+		else {
+			m_slots.emplace_back();
+			index = static_cast<uint32_t>(m_slots.size() - 1);
+		}
+		Slot& slot = m_slots[index];
+		// Ids stay below 2^63, which SRAL.cpp uses to tell scheduled output apart.
+		slot.generation = (slot.generation + 1) & 0x7fffffff;
+		if (slot.generation == 0) slot.generation = 1;
+		slot.used = true;
+		return index;
+	}
+
+	// Unlinks a slot from the queue and puts it on the free list.
+	void OutputQueue::Release(uint32_t index) {
+		Slot& slot = m_slots[index];
+		m_bytes -= slot.output.text.size();
+		slot.output = QueuedOutput();
+		if (slot.channel != kNoChannel) m_channels.erase(slot.channel);
+		slot.channel = kNoChannel;
+		if (slot.prev != kNone) m_slots[slot.prev].next = slot.next;
+		else m_head = slot.next;
+		if (slot.next != kNone) m_slots[slot.next].prev = slot.prev;
+		else m_tail = slot.prev;
+		slot.used = false;
+		slot.prev = kNone;
+		slot.next = m_free;
+		m_free = index;
+		m_size--;
+	}
+
+	uint64_t OutputQueue::Push(QueuedOutput&& output, int channel, bool* replaced) {
+		if (replaced) *replaced = false;
+		if (channel != kNoChannel) {
+			auto it = m_channels.find(channel);
+			if (it != m_channels.end()) {
+				// The new message keeps the place of the pending one, under a new id.
+				Slot& slot = m_slots[it->second];
+				m_bytes = m_bytes - slot.output.text.size() + output.text.size();
+				slot.generation = (slot.generation + 1) & 0x7fffffff;
+				if (slot.generation == 0) slot.generation = 1;
+				slot.output = std::move(output);
+				slot.output.id = MakeId(it->second, slot.generation);
+				if (replaced) *replaced = true;
+				return slot.output.id;
+			}
+		}
+		const uint32_t index = Allocate();
+		Slot& slot = m_slots[index];
+		m_bytes += output.text.size();
+		slot.output = std::move(output);
+		slot.output.id = MakeId(index, slot.generation);
+		slot.channel = channel;
+		slot.prev = m_tail;
+		slot.next = kNone;
+		if (m_tail != kNone) m_slots[m_tail].next = index;
+		else m_head = index;
+		m_tail = index;
+		m_size++;
+		if (channel != kNoChannel) m_channels.emplace(channel, index);
+		return slot.output.id;
+	}
+
+	bool OutputQueue::Pop(QueuedOutput& output) {
+		if (m_head == kNone) return false;
+		Slot& slot = m_slots[m_head];
+		output = std::move(slot.output);
+		// Release accounts for the text it finds in the slot.
+		m_bytes -= output.text.size();
+		slot.output = QueuedOutput();
+		Release(m_head);
+		return true;
+	}
+
+	uint64_t OutputQueue::MergeIntoBack(const QueuedOutput& output) {
+		if (m_tail == kNone) return 0;
+		Slot& back = m_slots[m_tail];
+		if (back.channel != kNoChannel || back.output.engine != output.engine) return 0;
+		if (!back.output.speak || !output.speak || back.output.ssml || output.ssml) return 0;
+		if (back.output.params.flags != 0 || output.params.flags != 0) return 0;
+		back.output.text += '\n';
+		back.output.text += output.text;
+		back.output.interrupt = back.output.interrupt || output.interrupt;
+		// The merged output is as fresh as its newest part.
+		back.output.deadline = output.deadline;
+		m_bytes += output.text.size() + 1;
+		return back.output.id;
+	}
+
+	bool OutputQueue::Cancel(uint64_t id) {
+		const uint32_t index = static_cast<uint32_t>(id);
+		if (index >= m_slots.size()) return false;
+		const Slot& slot = m_slots[index];
+		if (!slot.used || slot.generation != static_cast<uint32_t>(id >> 32)) return false;
+		Release(index);
+		return true;
+	}
+
+	size_t OutputQueue::CancelIf(int tag) {
+		size_t cancelled = 0;
+		for (uint32_t index = m_head; index != kNone;) {
+			const uint32_t next = m_slots[index].next;
+			if (m_slots[index].output.tag == tag) {
+				Release(index);
+				cancelled++;
+			}
+			index = next;
+		}
+		return cancelled;
+	}
+
+	void OutputQueue::Clear() {
+		// Slots are kept, so that the generations of their ids keep counting.
+		for (uint32_t index = m_head; index != kNone;) {
+			const uint32_t next = m_slots[index].next;
+			Release(index);
+			index = next;
+		}
+	}
+}
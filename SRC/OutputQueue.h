@@ -0,0 +1,110 @@
+#ifndef OUTPUTQUEUE_H_
+#define OUTPUTQUEUE_H_
+#pragma once
+#include "Allocations.h"
+#include "Engine.h"
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Sral {
+
+	struct QueuedOutput {
+		std::string text;
+		bool interrupt = false;
+		bool braille = false;
+		bool speak = false;
+		bool ssml = false;
+		int time = 0;
+		Engine* engine = nullptr;
+		uint64_t queuedAt = 0;
+		// LatencyTracker::Now() after which the output is dropped instead of spoken, or 0 to never expire.
+		uint64_t deadline = 0;
+		// See SRAL_Cancel and SRAL_CancelIf. The id is assigned when the output is queued or scheduled.
+		uint64_t id = 0;
+		int tag = 0;
+		// See SRAL_SpeakWithParams; flags is 0 for output without parameters of its own.
+		SRAL_UtteranceParams params{};
+
+		bool Expired(uint64_t now) const {
+			return deadline != 0 && now >= deadline;
+		}
+	};
+
+	// The queue of delayed and channel output, spoken in order by the output thread.
+	// Entries live in a pool of slots linked into a FIFO, so that an entry can be found and changed in place:
+	// each channel maps to the slot of its pending entry, and a new message on the channel replaces that
+	// entry's text without moving it or walking the queue. Ids are a slot index and a generation that changes
+	// whenever the slot is reused, so an entry is also cancelled by id without a search, and stale ids miss.
+	// Not thread safe; SRAL.cpp guards it with a mutex.
+	class OutputQueue {
+	public:
+		static constexpr int kNoChannel = -1;
+
+		// Adds output to the end of the queue, or replaces the pending output of the channel if it has one
+		// (setting replaced). Returns the id of the output, never 0.
+		uint64_t Push(QueuedOutput&& output, int channel = kNoChannel, bool* replaced = nullptr);
+
+		// The output at the front of the queue, or nullptr if it is empty.
+		const QueuedOutput* Front() const {
+			return m_head != kNone ? &m_slots[m_head].output : nullptr;
+		}
+
+		// Removes the output at the front of the queue.
+		bool Pop(QueuedOutput& output);
+
+		// Appends the text of output to the output at the back of the queue if both are plain speech without parameters
+		// for the same engine and the back is not on a channel. Returns the id of the merged output, or 0 if they cannot be merged.
+		uint64_t MergeIntoBack(const QueuedOutput& output);
+
+		// Removes the output with the given id if it is still queued.
+		bool Cancel(uint64_t id);
+		// Removes all queued output with the given tag and returns how much was removed.
+		size_t CancelIf(int tag);
+
+		void Clear();
+		// Whether the channel has output waiting, which a new message on the channel would replace.
+		bool Pending(int channel) const {
+			return m_channels.find(channel) != m_channels.end();
+		}
+		bool Empty() const {
+			return m_head == kNone;
+		}
+		size_t Size() const {
+			return m_size;
+		}
+		// The total size of the queued text.
+		size_t Bytes() const {
+			return m_bytes;
+		}
+
+	private:
+		static constexpr uint32_t kNone = UINT32_MAX;
+
+		struct Slot {
+			QueuedOutput output;
+			int channel = kNoChannel;
+			uint32_t generation = 0;
+			bool used = false;
+			uint32_t prev = kNone;
+			uint32_t next = kNone;
+		};
+
+		static uint64_t MakeId(uint32_t index, uint32_t generation) {
+			return (static_cast<uint64_t>(generation) << 32) | index;
+		}
+		uint32_t Allocate();
+		void Release(uint32_t index);
+
+		std::vector<Slot, Allocations::Allocator<Slot>> m_slots;
+		uint32_t m_free{kNone};
+		uint32_t m_head{kNone};
+		uint32_t m_tail{kNone};
+		size_t m_size{0};
+		size_t m_bytes{0};
+		std::unordered_map<int, uint32_t, std::hash<int>, std::equal_to<int>, Allocations::Allocator<std::pair<const int, uint32_t>>> m_channels;
+	};
+}
+
+#endif
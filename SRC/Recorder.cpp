@@ -0,0 +1,180 @@
+#include "../Include/SRAL.h"
+#include "Recorder.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+namespace Sral {
+	namespace Recorder {
+		std::atomic<bool> g_active{false};
+
+		static std::mutex g_fileMutex;
+		static FILE* g_file = nullptr;
+		static uint64_t g_startTime = 0;
+		static std::atomic<uint32_t> g_nextThreadId{1};
+		static thread_local uint32_t t_threadId = 0;
+		static thread_local int t_depth = 0;
+
+		static uint64_t Now() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		// Only plain scalar parameters can be reproduced, pointers to voice arrays or JNI objects cannot.
+		static bool ScalarValue(int param, const void* value, int32_t* out) {
+			if (value == nullptr) return false;
+			switch (param) {
+			case SRAL_PARAM_ENABLE_SPELLING:
+			case SRAL_PARAM_USE_CHARACTER_DESCRIPTIONS:
+				*out = *reinterpret_cast<const bool*>(value) ? 1 : 0;
+				return true;
+			case SRAL_PARAM_SPEECH_RATE:
+			case SRAL_PARAM_SPEECH_VOLUME:
+			case SRAL_PARAM_VOICE_INDEX:
+			case SRAL_PARAM_SYMBOL_LEVEL:
+			case SRAL_PARAM_SAPI_TRIM_THRESHOLD:
+				*out = *reinterpret_cast<const int*>(value);
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// Calls whose record is written when they return, with the utterance id they returned.
+		static bool ReturnsId(Call call) {
+			switch (call) {
+			case CALL_SPEAK_ON_CHANNEL:
+			case CALL_SPEAK_AT:
+			case CALL_SPEAK_AFTER:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// Must be called with g_fileMutex held.
+		static void Write(const TraceRecord& record, const void* data) {
+			if (g_file == nullptr) return;
+			fwrite(&record, sizeof(record), 1, g_file);
+			if (record.data) fwrite(data, record.data, 1, g_file);
+		}
+
+		bool Start(const char* path) {
+			if (path == nullptr) return false;
+			std::lock_guard<std::mutex> lock(g_fileMutex);
+			if (g_file) fclose(g_file);
+			g_file = fopen(path, "wb");
+			if (g_file == nullptr) {
+				g_active.store(false);
+				return false;
+			}
+			TraceHeader header;
+			memcpy(header.magic, kMagic, sizeof(header.magic));
+			header.version = kVersion;
+			header.recordSize = sizeof(TraceRecord);
+			fwrite(&header, sizeof(header), 1, g_file);
+			g_startTime = Now();
+			g_active.store(true);
+			return true;
+		}
+
+		void Stop() {
+			g_active.store(false);
+			std::lock_guard<std::mutex> lock(g_fileMutex);
+			if (g_file) {
+				fclose(g_file);
+				g_file = nullptr;
+			}
+		}
+
+		void Guard::Enter(Call call, int engine, bool explicitEngine, bool interrupt, int arg, const char* text, const void* value, const void* data, uint32_t size) {
+			m_entered = true;
+			if (t_depth++ > 0) return;
+			if (t_threadId == 0) t_threadId = g_nextThreadId.fetch_add(1);
+
+			TraceRecord& record = m_record;
+			record = TraceRecord{};
+			record.thread = t_threadId;
+			record.payload = text ? static_cast<uint32_t>(strlen(text)) : 0;
+			record.engine = engine;
+			record.arg = arg;
+			record.call = call;
+			record.flags = FLAG_NONE;
+			if (interrupt) record.flags |= FLAG_INTERRUPT;
+			if (explicitEngine) record.flags |= FLAG_EXPLICIT_ENGINE;
+			if (call == CALL_SET_ENGINE_PARAMETER) {
+				if (ScalarValue(arg, value, &record.value)) record.flags |= FLAG_HAS_VALUE;
+			}
+			else if (call == CALL_CANCEL) {
+				record.id = *static_cast<const uint64_t*>(value);
+			}
+			else if (value) {
+				record.value = *static_cast<const int*>(value);
+				record.flags |= FLAG_HAS_VALUE;
+			}
+			record.data = data ? size : 0;
+			m_data = data;
+
+			std::lock_guard<std::mutex> lock(g_fileMutex);
+			// Taken under the lock so that records in the file are ordered by time.
+			record.time = Now() - g_startTime;
+			if (ReturnsId(call)) {
+				m_pending = true;
+				return;
+			}
+			Write(record, data);
+		}
+
+		void Guard::Leave() {
+			t_depth--;
+			if (!m_pending) return;
+			std::lock_guard<std::mutex> lock(g_fileMutex);
+			Write(m_record, m_data);
+		}
+
+		const char* CallName(uint16_t call) {
+			switch (call) {
+			case CALL_SPEAK: return "Speak";
+			case CALL_SPEAK_TO_MEMORY: return "SpeakToMemory";
+			case CALL_SPEAK_SSML: return "SpeakSsml";
+			case CALL_BRAILLE: return "Braille";
+			case CALL_OUTPUT: return "Output";
+			case CALL_STOP_SPEECH: return "StopSpeech";
+			case CALL_PAUSE_SPEECH: return "PauseSpeech";
+			case CALL_RESUME_SPEECH: return "ResumeSpeech";
+			case CALL_IS_SPEAKING: return "IsSpeaking";
+			case CALL_GET_CURRENT_ENGINE: return "GetCurrentEngine";
+			case CALL_SET_ENGINE_PARAMETER: return "SetEngineParameter";
+			case CALL_GET_ENGINE_PARAMETER: return "GetEngineParameter";
+			case CALL_INITIALIZE: return "Initialize";
+			case CALL_UNINITIALIZE: return "Uninitialize";
+			case CALL_DELAY: return "Delay";
+			case CALL_GET_ACTIVE_ENGINES: return "GetActiveEngines";
+			case CALL_SET_ENGINES_EXCLUDE: return "SetEnginesExclude";
+			case CALL_SPEAK_ON_CHANNEL: return "SpeakOnChannel";
+			case CALL_SET_FAILOVER_POLICY: return "SetFailoverPolicy";
+			case CALL_SET_ENGINE_PRIORITY: return "SetEnginePriority";
+			case CALL_SET_ADAPTIVE_ENGINE_SELECTION: return "SetAdaptiveEngineSelection";
+			case CALL_ADD_TEXT_FILTER: return "AddTextFilter";
+			case CALL_ADD_RATE_LIMIT: return "AddRateLimit";
+			case CALL_CLEAR_MIDDLEWARE: return "ClearMiddleware";
+			case CALL_ADD_COALESCER: return "AddCoalescer";
+			case CALL_SET_OUTPUT_TTL: return "SetOutputTTL";
+			case CALL_SET_QUEUE_LIMITS: return "SetQueueLimits";
+			case CALL_SPEAK_AT: return "SpeakAt";
+			case CALL_SPEAK_AFTER: return "SpeakAfter";
+			case CALL_SET_OUTPUT_TAG: return "SetOutputTag";
+			case CALL_CANCEL: return "Cancel";
+			case CALL_CANCEL_IF: return "CancelIf";
+			case CALL_SET_AGGREGATION: return "SetAggregation";
+			case CALL_SET_UTTERANCE_CALLBACK: return "SetUtteranceCallback";
+			case CALL_PUMP: return "Pump";
+			case CALL_SPEAK_WITH_PARAMS: return "SpeakWithParams";
+			case CALL_SET_ENGINE_PARAMETERS: return "SetEngineParameters";
+			case CALL_GET_ENGINE_PARAMETERS: return "GetEngineParameters";
+			case CALL_SET_ALLOCATOR: return "SetAllocator";
+			default: return "Unknown";
+			}
+		}
+	}
+}
@@ -0,0 +1,140 @@
+#ifndef RECORDER_H_
+#define RECORDER_H_
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// Records public SRAL_* calls to a compact binary file, to be replayed by sral-replay.
+// File layout (native byte order): one TraceHeader followed by TraceRecords, each followed by its argument block
+// of TraceRecord::data bytes. Records are in time order, except that calls returning an utterance id are written
+// when they return, so only the order within a thread is reliable.
+
+namespace Sral {
+	namespace Recorder {
+		enum Call : uint16_t {
+			CALL_SPEAK = 1,
+			CALL_SPEAK_TO_MEMORY,
+			CALL_SPEAK_SSML,
+			CALL_BRAILLE,
+			CALL_OUTPUT,
+			CALL_STOP_SPEECH,
+			CALL_PAUSE_SPEECH,
+			CALL_RESUME_SPEECH,
+			CALL_IS_SPEAKING,
+			CALL_GET_CURRENT_ENGINE,
+			CALL_SET_ENGINE_PARAMETER,
+			CALL_GET_ENGINE_PARAMETER,
+			CALL_INITIALIZE,
+			CALL_UNINITIALIZE,
+			CALL_DELAY,
+			CALL_GET_ACTIVE_ENGINES,
+			CALL_SET_ENGINES_EXCLUDE,
+			CALL_SPEAK_ON_CHANNEL,
+			CALL_SET_FAILOVER_POLICY,
+			CALL_SET_ENGINE_PRIORITY,
+			CALL_SET_ADAPTIVE_ENGINE_SELECTION,
+			CALL_ADD_TEXT_FILTER,
+			CALL_ADD_RATE_LIMIT,
+			CALL_CLEAR_MIDDLEWARE,
+			CALL_ADD_COALESCER,
+			CALL_SET_OUTPUT_TTL,
+			CALL_SET_QUEUE_LIMITS,
+			CALL_SPEAK_AT,
+			CALL_SPEAK_AFTER,
+			CALL_SET_OUTPUT_TAG,
+			CALL_CANCEL,
+			CALL_CANCEL_IF,
+			CALL_SET_AGGREGATION,
+			CALL_SET_UTTERANCE_CALLBACK,
+			CALL_PUMP,
+			CALL_SPEAK_WITH_PARAMS,
+			CALL_SET_ENGINE_PARAMETERS,
+			CALL_GET_ENGINE_PARAMETERS,
+			CALL_SET_ALLOCATOR,
+			CALL_COUNT
+		};
+
+		enum Flags : uint16_t {
+			FLAG_NONE = 0,
+			FLAG_INTERRUPT = 1,
+			// Recorded through an SRAL_*Ex function with an explicit engine.
+			FLAG_EXPLICIT_ENGINE = 2,
+			// TraceRecord::value holds the parameter value, or another int argument such as the output flags of SpeakOnChannel.
+			FLAG_HAS_VALUE = 4
+		};
+
+		struct TraceHeader {
+			char magic[8];
+			uint32_t version;
+			uint32_t recordSize;
+		};
+
+		struct TraceRecord {
+			uint64_t time;    // Nanoseconds since recording started.
+			uint32_t thread;  // Small sequential id of the calling thread.
+			uint32_t payload; // Text size in bytes.
+			int32_t engine;
+			int32_t arg;      // Parameter id, delay time, exclude mask or channel, depending on the call.
+			int32_t value;    // Scalar parameter value, see FLAG_HAS_VALUE.
+			uint16_t call;
+			uint16_t flags;
+			uint64_t id;      // Utterance id returned by or passed to the call, if it has one.
+			uint32_t data;    // Size of the argument block that follows, for arguments that do not fit above.
+			                  // Calls with more scalar arguments than arg and value can hold store all of them there, as int32_t.
+			uint32_t reserved;
+		};
+		static_assert(sizeof(TraceRecord) == 48, "TraceRecord is part of the file format");
+
+		constexpr char kMagic[8] = { 'S', 'R', 'A', 'L', 'R', 'E', 'C', '1' };
+		constexpr uint32_t kVersion = 1;
+
+		extern std::atomic<bool> g_active;
+
+		inline bool Active() {
+			return g_active.load(std::memory_order_relaxed);
+		}
+
+		bool Start(const char* path);
+		void Stop();
+		const char* CallName(uint16_t call);
+
+		// Logs one call unless it is made from inside another recorded call
+		// (SRAL_Speak forwarding to SRAL_SpeakEx must appear only once).
+		// data points to size bytes of further arguments, which must stay valid until the guard is destroyed.
+		class Guard {
+		public:
+			Guard(Call call, int engine, bool explicitEngine, bool interrupt, int arg, const char* text, const void* value = nullptr, const void* data = nullptr, uint32_t size = 0) {
+				if (!Active()) return;
+				Enter(call, engine, explicitEngine, interrupt, arg, text, value, data, size);
+			}
+
+			~Guard() {
+				if (m_entered) Leave();
+			}
+
+			Guard(const Guard&) = delete;
+			Guard& operator=(const Guard&) = delete;
+
+			// Records the utterance id the call returns, and returns it.
+			uint64_t Returned(uint64_t id) {
+				if (m_pending) m_record.id = id;
+				return id;
+			}
+
+		private:
+			void Enter(Call call, int engine, bool explicitEngine, bool interrupt, int arg, const char* text, const void* value, const void* data, uint32_t size);
+			void Leave();
+			bool m_entered = false;
+			// Set while the record waits for the call to return.
+			bool m_pending = false;
+			TraceRecord m_record;
+			const void* m_data;
+		};
+	}
+}
+
+#define SRAL_RECORD_CONCAT_(a, b) a##b
+#define SRAL_RECORD_CONCAT(a, b) SRAL_RECORD_CONCAT_(a, b)
+#define SRAL_RECORD(...) ::Sral::Recorder::Guard SRAL_RECORD_CONCAT(sral_record_, __LINE__)(__VA_ARGS__)
+
+#endif
@@ -1,5 +1,7 @@
 #ifdef _WIN32
 #include "SAPI.h"
+#include "Allocations.h"
+#include "Trace.h"
 #include <cstdio>
 #include<string>
 #include<thread>
@@ -80,7 +82,9 @@ static char* trim(char* data, unsigned long* size, WAVEFORMATEX* wfx, int thresh
 	}
 
 	int trimmedSize = (endIndex - startIndex + 1) * samplesPerFrame;
-	char* trimmedData = new char[trimmedSize];
+	// Also returned by SRAL_SpeakToMemory, whose callers free it with SRAL_free.
+	char* trimmedData = (char*)Sral::Allocations::Allocate(trimmedSize);
+	if (trimmedData == nullptr) return nullptr;
 	memcpy(trimmedData, data + startIndex * samplesPerFrame, trimmedSize);
 	*size = trimmedSize;
 	return trimmedData;
@@ -90,6 +94,7 @@ static char* trim(char* data, unsigned long* size, WAVEFORMATEX* wfx, int thresh
 struct PCMData {
 	unsigned char* data;
 	unsigned long size;
+	uint64_t id;
 };
 
 static std::vector<PCMData> g_dataQueue;
@@ -97,6 +102,8 @@ static std::mutex g_dataQueueMutex;
 static std::condition_variable g_dataQueueCv;
 static std::atomic<bool> g_threadStarted = false;
 static std::atomic<bool> g_isSpeaking = false;
+static std::atomic<uint64_t> g_nextUtteranceId = 0;
+static std::atomic<Sral::LatencyTracker*> g_latency = nullptr;
 
 static void sapi_thread() {
 	if (g_player == nullptr) {
@@ -122,12 +129,21 @@ static void sapi_thread() {
 		g_isSpeaking.store(true);
 
 		if (current_data.data) {
+			Sral::LatencyTracker* tracker = g_latency.load();
+			if (tracker) tracker->Began(current_data.id);
+			SRAL_TRACE_SCOPE("sapi", "feed", current_data.id);
 			auto result = safeCallVal<WasapiPlayer, HRESULT>(g_player.get(), &WasapiPlayer::feed, current_data.data, current_data.size, nullptr);
-			delete[] current_data.data;
+			Sral::Allocations::Free(current_data.data);
 
 			if (result.has_value() && SUCCEEDED(*result)) {
 				result = safeCallVal<WasapiPlayer, HRESULT>(g_player.get(), &WasapiPlayer::sync);
 			}
+			if (tracker) {
+				if (result.has_value() && SUCCEEDED(*result))
+					tracker->Ended(current_data.id);
+				else
+					tracker->Cancelled(current_data.id);
+			}
 		}
 
 		{
@@ -138,9 +154,11 @@ static void sapi_thread() {
 		}
 	}
 	std::unique_lock<std::mutex> lock(g_dataQueueMutex);
+	Sral::LatencyTracker* tracker = g_latency.load();
 	for (PCMData& data : g_dataQueue) {
+		if (tracker) tracker->Cancelled(data.id);
 		if (data.data) {
-			delete[] data.data;
+			Sral::Allocations::Free(data.data);
 			data.data = nullptr;
 		}
 	}
@@ -184,6 +202,7 @@ namespace Sral {
 			g_player.reset();
 			return false;
 		}
+		g_latency.store(&latency);
 		g_threadStarted.store(true);
 		speechThread = std::thread(sapi_thread);
 		speechThread.detach();
@@ -191,7 +210,7 @@ namespace Sral {
 	}
 
 	bool Sapi::Uninitialize() {
-		ReleaseAllStrings();
+		m_strings.Clear();
 		this->voiceIndex = 0;
 		if (!instance || g_player == nullptr)return false;
 		g_threadStarted.store(false);
@@ -205,6 +224,7 @@ namespace Sral {
 			g_player.reset();
 		}
 		g_isSpeaking.store(false);
+		g_latency.store(nullptr);
 		return true;
 	}
 
@@ -215,6 +235,8 @@ namespace Sral {
 	bool Sapi::Speak(const char* text, bool interrupt) {
 		if (instance == nullptr || g_player == nullptr)
 			return false;
+		// Synthesis happens right here, so it counts towards the submission delay.
+		const uint64_t submitted = LatencyTracker::Now();
 		if (interrupt) {
 			StopSpeech();
 
@@ -252,9 +274,11 @@ namespace Sral {
 		char* data = (char*)this->SpeakToMemory(text, &buffer_size, nullptr, nullptr, nullptr);
 		if (!data || buffer_size == 0) return false;
 
-		PCMData dat = { 0, 0 };
+		PCMData dat = { 0, 0, 0 };
 		dat.data = (unsigned char*)data;
 		dat.size = buffer_size;
+		dat.id = ++g_nextUtteranceId;
+		latency.Submitted(dat.id, submitted);
 		if (this->paused) {
 			this->paused = false;
 			if (!interrupt)
@@ -273,7 +297,11 @@ namespace Sral {
 		if (instance == nullptr)return nullptr;
 		std::string text_str(text);
 		unsigned long bytes;
-		char* audio_ptr = blastspeak_speak_to_memory(&*instance, &bytes, text_str.c_str());
+		char* audio_ptr;
+		{
+			SRAL_TRACE_SCOPE("sapi", "synthesize", 0);
+			audio_ptr = blastspeak_speak_to_memory(&*instance, &bytes, text_str.c_str());
+		}
 		if (audio_ptr == nullptr)
 			return nullptr;
 
@@ -297,10 +325,11 @@ namespace Sral {
 		case SRAL_PARAM_SAPI_TRIM_THRESHOLD:
 			this->trimThreshold = *reinterpret_cast<const int*>(value);
 			break;
+		// Parameters are int like on every other engine; blastspeak takes them as long.
 		case SRAL_PARAM_SPEECH_RATE:
-			return blastspeak_set_voice_rate(&*instance, *reinterpret_cast<const long*>(value));
+			return blastspeak_set_voice_rate(&*instance, *reinterpret_cast<const int*>(value));
 		case SRAL_PARAM_SPEECH_VOLUME:
-			return blastspeak_set_voice_volume(&*instance, *reinterpret_cast<const long*>(value));
+			return blastspeak_set_voice_volume(&*instance, *reinterpret_cast<const int*>(value));
 		case SRAL_PARAM_VOICE_INDEX: {
 			int result = blastspeak_set_voice(&*instance, *reinterpret_cast<const int*>(value));
 			if (result) {
@@ -324,21 +353,26 @@ namespace Sral {
 			*(int*)value = this->trimThreshold;
 			return true;
 		case SRAL_PARAM_SPEECH_RATE: {
-			return blastspeak_get_voice_rate(&*instance, (long*)value);
+			long rate;
+			if (!blastspeak_get_voice_rate(&*instance, &rate)) return false;
+			*(int*)value = static_cast<int>(rate);
+			return true;
 		}
 		case SRAL_PARAM_SPEECH_VOLUME: {
-			return blastspeak_get_voice_volume(&*instance, (long*)value);
+			long volume;
+			if (!blastspeak_get_voice_volume(&*instance, &volume)) return false;
+			*(int*)value = static_cast<int>(volume);
+			return true;
 		}
 		case SRAL_PARAM_VOICE_PROPERTIES: {
-			ReleaseAllStrings();
 			SRAL_VoiceInfo* voiceProperties = (SRAL_VoiceInfo*)value;
 			int index = 0;
 			for (; voiceProperties && instance && index < instance->voice_count; ++index) {
 				voiceProperties[index].index = index;
-				voiceProperties[index].name = AddString(blastspeak_get_voice_description(&*instance, index));
-				voiceProperties[index].language = AddString(blastspeak_get_voice_languages(&*instance, index));
-				voiceProperties[index].gender = AddString(blastspeak_get_voice_attribute(&*instance, index, "Gender"));
-				voiceProperties[index].vendor = AddString(blastspeak_get_voice_attribute(&*instance, index, "Vendor"));
+				voiceProperties[index].name = m_strings.Intern(blastspeak_get_voice_description(&*instance, index));
+				voiceProperties[index].language = m_strings.Intern(blastspeak_get_voice_languages(&*instance, index));
+				voiceProperties[index].gender = m_strings.Intern(blastspeak_get_voice_attribute(&*instance, index, "Gender"));
+				voiceProperties[index].vendor = m_strings.Intern(blastspeak_get_voice_attribute(&*instance, index, "Vendor"));
 			}
 
 			return true;
@@ -361,8 +395,9 @@ namespace Sral {
 		{
 			std::unique_lock<std::mutex> lock(g_dataQueueMutex);
 			for (PCMData& data : g_dataQueue) {
+				latency.Cancelled(data.id);
 				if (data.data) {
-					delete[] data.data;
+					Sral::Allocations::Free(data.data);
 					data.data = nullptr;
 				}
 			}
@@ -1,6 +1,15 @@
 #define SRAL_EXPORT
 #include "../Include/SRAL.h"
+#include "Allocations.h"
+#include "Encoding.h"
 #include "Engine.h"
+#include "EngineRegistry.h"
+#include "Middleware.h"
+#include "OutputQueue.h"
+#include "TimerWheel.h"
+#include "Recorder.h"
+#include "StaticDispatch.h"
+#include "Trace.h"
 #if defined(_WIN32)
 #define UNICODE
 #include "NVDA.h"
@@ -25,13 +34,19 @@
 #else
 #include "SpeechDispatcher.h"
 #endif
+#include <deque>
 #include <map>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
 #include <vector>
 #include <string>
 #include <chrono>
 #include <thread>
 #include <memory>
+#include <algorithm>
+#include <array>
+#include <cstdlib>
 
 class Timer {
 public:
@@ -56,72 +71,545 @@ private:
 
 
 static Sral::Engine* g_currentEngine{nullptr};
-static std::map<SRAL_Engines, std::unique_ptr<Sral::Engine>> g_engines;
+static Sral::EngineRegistry g_engines;
 static int g_excludes{SRAL_ENGINE_NONE};
 static int g_enginesFailedToInitialize{SRAL_ENGINE_NONE};
+
+#ifdef SRAL_STATIC_DISPATCH
+#if defined(_WIN32) && !defined(SRAL_NO_UIA)
+using BuiltinEngines = Sral::EngineSet<Sral::Nvda, Sral::Jaws, Sral::Zdsr, Sral::Uia, Sral::Sapi>;
+#elif defined(_WIN32)
+using BuiltinEngines = Sral::EngineSet<Sral::Nvda, Sral::Jaws, Sral::Zdsr, Sral::Sapi>;
+#elif defined(__APPLE__) && !defined(SRAL_NO_NSSPEECH)
+using BuiltinEngines = Sral::EngineSet<Sral::VoiceOver, Sral::AvSpeech, Sral::NsSpeech>;
+#elif defined(__APPLE__)
+using BuiltinEngines = Sral::EngineSet<Sral::VoiceOver, Sral::AvSpeech>;
+#elif defined(__ANDROID__)
+using BuiltinEngines = Sral::EngineSet<Sral::AndroidAccessibilityManager, Sral::AndroidTextToSpeech>;
+#else
+using BuiltinEngines = Sral::EngineSet<Sral::SpeechDispatcher>;
+#endif
+#else
+using BuiltinEngines = Sral::EngineSet<>;
+#endif
+// Calls on engines go through g_builtinEngines.Visit so that SRAL_STATIC_DISPATCH builds can devirtualize them.
+static BuiltinEngines g_builtinEngines;
+
+// Asks the engine whether it is active and publishes the answer, so that mask queries see it without asking again.
+static bool probe_active(Sral::Engine* engine) {
+	const bool active = g_builtinEngines.Visit(engine, [](auto* impl) { return impl->GetActive(); });
+	engine->PublishActive(active);
+	return active;
+}
+
+// Output goes through the engine's middleware chain if it has one, otherwise straight to the engine.
+// Engines without middleware take no lock; a chain is held shared for the call, see Engine::pipelineMutex.
+template <typename F>
+static decltype(auto) dispatch(Sral::Engine* engine, F&& f) {
+	if (engine->pipeline.load(std::memory_order_acquire) != nullptr) {
+		std::shared_lock<std::shared_mutex> lock(engine->pipelineMutex);
+		if (Sral::Engine* pipeline = engine->pipeline.load(std::memory_order_acquire)) return f(pipeline);
+	}
+	return g_builtinEngines.Visit(engine, f);
+}
 static bool g_initialized{false};
 
-struct QueuedOutput {
-	std::string text;
-	bool interrupt;
-	bool braille;
-	bool speak;
-	bool ssml;
-	int time;
-	Sral::Engine* engine;
+// Engines are started concurrently where the platform allows it (COM in the MTA on Windows, plain
+// sockets on Linux). Apple and Android engines stay on the calling thread: they depend on the main
+// thread's run loop or on a thread-bound JNIEnv.
+#if defined(__APPLE__) || defined(__ANDROID__)
+#define SRAL_SEQUENTIAL_STARTUP
+#endif
+
+struct EngineStartup {
+	std::thread thread;
+	int64_t time{-1}; // Microseconds spent in Engine::Initialize, -1 until it returns.
+};
+
+static std::map<SRAL_Engines, EngineStartup> g_startup;
+static std::mutex g_startupMutex;
+static std::condition_variable g_startupCv;
+// An engine may only be used once its bit is in g_enginesReady.
+static std::atomic<int> g_enginesPending{SRAL_ENGINE_NONE};
+static std::atomic<int> g_enginesReady{SRAL_ENGINE_NONE};
+
+struct FailoverPolicy {
+	bool enabled{false};
+	int budget{250};    // Milliseconds.
+	int cooldown{5000}; // Milliseconds.
 };
 
-static std::vector<QueuedOutput> g_delayedOutputs;
-static std::mutex g_delayedOutputsMutex;
+static FailoverPolicy g_failover;
+static std::mutex g_failoverMutex;
+// Engines that failed recently, with the steady clock time (in milliseconds) at which they become eligible again.
+static std::map<SRAL_Engines, int64_t> g_degradedUntil;
+static std::atomic<int> g_enginesDegraded{SRAL_ENGINE_NONE};
+static std::atomic<uint64_t> g_failoverFailures{0};
+static std::atomic<uint64_t> g_failoverSucceeded{0};
+static std::atomic<uint64_t> g_failoverExhausted{0};
+static std::atomic<uint64_t> g_failoverDegraded{0};
+
+static std::mutex g_selectionMutex;
+static std::vector<SRAL_Engines> g_priority; // See SRAL_SetEnginePriority.
+static std::atomic<bool> g_priorityPinned{false};
+static std::atomic<bool> g_adaptiveSelection{false};
+
+static Sral::OutputQueue g_outputQueue;
+static std::mutex g_outputQueueMutex;
 static std::atomic<bool> g_delayOperation{false};
 static std::atomic<bool> g_outputThreadRunning{false};
 
 static std::thread g_outputThread;
+// Set on the output thread, which cannot wait for itself to stop.
+static thread_local bool t_onOutputThread = false;
 
 static std::atomic<uint64_t> g_lastDelayTime{0};
+static std::atomic<int> g_outputTtl{0}; // See SRAL_SetOutputTTL.
+static std::atomic<int> g_outputTag{0}; // See SRAL_SetOutputTag.
+static std::atomic<uint64_t> g_outputsQueued{0};
+static std::atomic<uint64_t> g_outputsReplaced{0};
+static std::atomic<uint64_t> g_outputsSpoken{0};
+static std::atomic<uint64_t> g_outputsExpired{0};
+static std::atomic<uint64_t> g_outputsDropped{0};
+static std::atomic<uint64_t> g_outputsMerged{0};
+static std::atomic<uint64_t> g_outputsCancelled{0};
+
+// The queued or scheduled output that was last passed to an engine, which SRAL_Cancel can still stop while it is spoken.
+struct InFlightOutput {
+	uint64_t id = 0;
+	int tag = 0;
+	Sral::Engine* engine = nullptr;
+};
+static InFlightOutput g_inFlight;
+static std::mutex g_inFlightMutex;
+
+static void set_in_flight(const Sral::QueuedOutput& output) {
+	std::lock_guard<std::mutex> lock(g_inFlightMutex);
+	g_inFlight = { output.id, output.tag, output.engine };
+}
 
+struct QueueLimits {
+	size_t maxItems = 0; // 0 for no limit.
+	size_t maxBytes = 0;
+	int policy = SRAL_QUEUE_DROP_OLDEST;
+	int timeout = 0; // Milliseconds, for SRAL_QUEUE_BLOCK.
+};
+// Guarded by g_outputQueueMutex.
+static QueueLimits g_queueLimits;
+// Signalled when output leaves the queue, for producers blocked by SRAL_QUEUE_BLOCK.
+static std::condition_variable g_outputQueueSpace;
+// Signalled when output is queued, for the output thread waiting to aggregate more.
+static std::condition_variable g_outputQueueAdded;
+// Signalled when the output thread clears g_outputThreadRunning and exits; the thread is detached, so this is how
+// SRAL_Uninitialize knows that it has stopped.
+static std::condition_variable g_outputThreadStopped;
+
+struct Aggregation {
+	size_t maxBytes = 0; // 0 when disabled.
+	int timeout = 0;
+	int breakTime = 0;
+};
+// Guarded by g_outputQueueMutex.
+static Aggregation g_aggregation;
+static std::atomic<uint64_t> g_outputsAggregated{0};
+
+static std::mutex g_utteranceCallbackMutex;
+static SRAL_UtteranceCallback g_utteranceCallback = nullptr;
+static void* g_utteranceCallbackData = nullptr;
+
+// In pump mode, reached marks wait here until SRAL_Pump delivers them. Guarded by g_utteranceCallbackMutex.
+static std::deque<uint64_t> g_pendingMarks;
+
+static constexpr char kMarkPrefix[] = "sral:";
+
+// Receives the SSML marks that engines report, see aggregate_output.
+static void mark_reached(const char* mark) {
+	if (mark == nullptr || strncmp(mark, kMarkPrefix, sizeof(kMarkPrefix) - 1) != 0) return;
+	const uint64_t id = strtoull(mark + sizeof(kMarkPrefix) - 1, nullptr, 10);
+	SRAL_UtteranceCallback callback;
+	void* user_data;
+	{
+		std::lock_guard<std::mutex> lock(g_utteranceCallbackMutex);
+		if (Sral::g_pumpMode.load()) {
+			if (g_utteranceCallback) g_pendingMarks.push_back(id);
+			return;
+		}
+		callback = g_utteranceCallback;
+		user_data = g_utteranceCallbackData;
+	}
+	if (callback) callback(id, user_data);
+}
+
+static void append_marked(std::string& ssml, const Sral::QueuedOutput& output) {
+	XmlEncode(output.text.c_str(), ssml);
+	ssml += "<mark name=\"";
+	ssml += kMarkPrefix;
+	ssml += std::to_string(output.id);
+	ssml += "\"/>";
+}
+
+// Pulls the plain speech queued right behind first into a single SSML utterance, waiting up to the aggregation
+// timeout for more to arrive if wait is set. The messages keep their order and are separated by breaks, each
+// followed by a mark naming its id. Leaves first alone if there is nothing to aggregate it with.
+static void aggregate_output(Sral::QueuedOutput& first, bool wait) {
+	auto compatible = [&first](const Sral::QueuedOutput& output) {
+		return output.engine == first.engine && output.speak && !output.ssml && !output.interrupt && output.params.flags == 0;
+	};
+	if (!first.speak || first.ssml || first.params.flags != 0 || !(first.engine->GetFeatures() & SRAL_SUPPORTS_SSML))return;
+	std::unique_lock<std::mutex> lock(g_outputQueueMutex);
+	const Aggregation aggregation = g_aggregation;
+	if (aggregation.maxBytes == 0)return;
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(aggregation.timeout);
+	size_t total = first.text.size();
+	std::string ssml;
+	Sral::QueuedOutput next;
+	while (g_delayOperation.load()) {
+		const Sral::QueuedOutput* front = g_outputQueue.Front();
+		if (front == nullptr) {
+			if (!wait || total >= aggregation.maxBytes || g_outputQueueAdded.wait_until(lock, deadline) == std::cv_status::timeout) break;
+			continue;
+		}
+		if (!compatible(*front) || total + front->text.size() > aggregation.maxBytes) break;
+		g_outputQueue.Pop(next);
+		g_outputQueueSpace.notify_all();
+		if (next.Expired(Sral::LatencyTracker::Now())) {
+			SRAL_TRACE_INSTANT("queue", "expired", next.engine->GetNumber());
+			g_outputsExpired++;
+			continue;
+		}
+		if (ssml.empty()) {
+			ssml = "<speak>";
+			append_marked(ssml, first);
+		}
+		if (aggregation.breakTime > 0) ssml += "<break time=\"" + std::to_string(aggregation.breakTime) + "ms\"/>";
+		append_marked(ssml, next);
+		total += next.text.size();
+		g_outputsSpoken++;
+		g_outputsAggregated++;
+	}
+	if (ssml.empty())return;
+	ssml += "</speak>";
+	first.text = std::move(ssml);
+	first.ssml = true;
+}
+
+// Pops the output at the front of the queue, dropping any that expired while it waited. Called with g_outputQueueMutex held.
+static bool pop_output(Sral::QueuedOutput& output) {
+	// Late speech is worse than none.
+	bool popped = false;
+	while ((popped = g_outputQueue.Pop(output)) && output.Expired(Sral::LatencyTracker::Now())) {
+		SRAL_TRACE_INSTANT("queue", "expired", output.engine->GetNumber());
+		g_outputsExpired++;
+	}
+	g_outputQueueSpace.notify_all();
+	return popped;
+}
+
+static void speak_output(Sral::QueuedOutput& output, bool wait) {
+	SRAL_TRACE_SINCE("queue", "queued", output.queuedAt, output.engine->GetNumber());
+	g_outputsSpoken++;
+	set_in_flight(output);
+	aggregate_output(output, wait);
+	// Stopped or paused while it was being aggregated, so it was meant to be dropped with the rest of the queue.
+	if (!g_delayOperation.load())return;
+
+	if (output.speak) {
+		if (output.ssml) {
+			SRAL_TRACE_SCOPE("engine", "SpeakSsml", output.engine->GetNumber());
+			dispatch(output.engine, [&](auto* impl) { return impl->SpeakSsml(output.text.c_str(), output.interrupt); });
+		}
+		else if (output.params.flags != 0) {
+			SRAL_TRACE_SCOPE("engine", "SpeakWithParams", output.engine->GetNumber());
+			dispatch(output.engine, [&](auto* impl) { return impl->SpeakWithParams(output.text.c_str(), output.interrupt, output.params); });
+		}
+		else {
+			SRAL_TRACE_SCOPE("engine", "Speak", output.engine->GetNumber());
+			dispatch(output.engine, [&](auto* impl) { return impl->Speak(output.text.c_str(), output.interrupt); });
+		}
+
+	}
+	else if (output.braille) {
+		SRAL_TRACE_SCOPE("engine", "Braille", output.engine->GetNumber());
+		dispatch(output.engine, [&](auto* impl) { return impl->Braille(output.text.c_str()); });
+	}
+}
 
 static void output_thread() {
-	g_outputThreadRunning.store(true);
+	t_onOutputThread = true;
 	static Timer s_timer;
 	s_timer.restart();
-	while (g_delayOperation.load()) {
-		QueuedOutput current_output;
+	while (true) {
+		Sral::Engine* engine;
+		int time;
+		bool interrupt;
+		uint64_t deadline;
 		{
-			std::unique_lock<std::mutex> lock(g_delayedOutputsMutex);
+			std::unique_lock<std::mutex> lock(g_outputQueueMutex);
 
-			if (!g_delayOperation.load() || g_delayedOutputs.empty()) {
+			// Cleared under the lock, so that output queued from now on starts a new thread.
+			if (!g_delayOperation.load()) {
+				g_outputThreadRunning.store(false);
+				g_outputThreadStopped.notify_all();
+				break;
+			}
+			const Sral::QueuedOutput* front = g_outputQueue.Front();
+			if (front == nullptr) {
+				g_delayOperation.store(false);
+				g_lastDelayTime = 0;
+				g_outputThreadRunning.store(false);
+				g_outputThreadStopped.notify_all();
 				break;
 			}
+			engine = front->engine;
+			time = front->time;
+			interrupt = front->interrupt;
+			deadline = front->deadline;
+		}
 
-			current_output = g_delayedOutputs.front();
-			g_delayedOutputs.erase(g_delayedOutputs.begin());
+		// Queued output waits until the engine has been quiet for its delay; interrupting output without a delay goes out at once.
+		// It stays in the queue while it waits, so that it can still be replaced or cancelled.
+		if (time > 0 || !interrupt) {
+			SRAL_TRACE_SCOPE("queue", "wait", time);
+			s_timer.restart();
+			while (g_delayOperation.load() && (deadline == 0 || Sral::LatencyTracker::Now() < deadline)) {
+				if (dispatch(engine, [](auto* impl) { return impl->IsSpeaking(); })) {
+					s_timer.restart();
+				}
+				else if (s_timer.elapsed() >= static_cast<uint64_t>(time)) {
+					break;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
 		}
 
-		s_timer.restart();
-		while (s_timer.elapsed() < current_output.time && g_delayOperation.load()) {
-			if (current_output.engine->IsSpeaking()) {
-				s_timer.restart();
+		Sral::QueuedOutput current_output;
+		{
+			std::unique_lock<std::mutex> lock(g_outputQueueMutex);
+			if (!g_delayOperation.load()) {
+				g_outputThreadRunning.store(false);
+				g_outputThreadStopped.notify_all();
+				break;
+			}
+			// Everything was cancelled or expired while waiting; the next iteration stops the thread.
+			if (!pop_output(current_output)) continue;
+		}
+		speak_output(current_output, true);
+	}
+}
+
+// When the engine was last seen speaking (or the output at the front started waiting) in pump mode.
+// Only touched by the thread that calls SRAL_Pump.
+static uint64_t g_pumpQuietSince = 0;
+
+// One iteration of output_thread for SRAL_Pump, which never waits: speaks the output at the front of the queue
+// if its engine has been quiet for its delay, and stops processing the queue the way the thread would stop.
+// Returns whether anything was spoken.
+static bool pump_output(uint64_t now) {
+	Sral::Engine* engine;
+	int time;
+	bool interrupt;
+	bool expired;
+	{
+		std::unique_lock<std::mutex> lock(g_outputQueueMutex);
+		if (!g_outputThreadRunning.load())return false;
+		const Sral::QueuedOutput* front = g_outputQueue.Front();
+		if (!g_delayOperation.load() || front == nullptr) {
+			if (front == nullptr) {
+				g_delayOperation.store(false);
+				g_lastDelayTime = 0;
 			}
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			g_outputThreadRunning.store(false);
+			g_pumpQuietSince = 0;
+			return false;
+		}
+		engine = front->engine;
+		time = front->time;
+		interrupt = front->interrupt;
+		expired = front->Expired(now);
+	}
+	if (!expired && (time > 0 || !interrupt)) {
+		if (dispatch(engine, [](auto* impl) { return impl->IsSpeaking(); })) {
+			g_pumpQuietSince = now;
+			return false;
 		}
+		if (g_pumpQuietSince == 0) g_pumpQuietSince = now;
+		if (now - g_pumpQuietSince < static_cast<uint64_t>(time) * 1000)return false;
+	}
+	Sral::QueuedOutput output;
+	{
+		std::unique_lock<std::mutex> lock(g_outputQueueMutex);
+		if (!pop_output(output))return false;
+	}
+	g_pumpQuietSince = 0;
+	speak_output(output, false);
+	return true;
+}
 
-		if (!g_delayOperation.load()) break;
+// Called with g_outputQueueMutex held, after queueing output.
+static void start_output_thread() {
+	g_delayOperation.store(true);
+	// In pump mode SRAL_Pump does the thread's work for as long as g_outputThreadRunning is set.
+	if (g_outputThreadRunning.exchange(true) || Sral::g_pumpMode.load())return;
+	g_outputThread = std::thread(output_thread);
+	g_outputThread.detach();
+}
+
+// Stops the output thread and waits until it has exited, after finishing any engine call it is in.
+static void stop_output_thread() {
+	std::unique_lock<std::mutex> lock(g_outputQueueMutex);
+	g_delayOperation.store(false);
+	// Ends a wait for more output to aggregate.
+	g_outputQueueAdded.notify_all();
+	// In pump mode there is no thread, only SRAL_Pump doing its work.
+	if (Sral::g_pumpMode.load()) {
+		g_outputThreadRunning.store(false);
+		return;
+	}
+	// Called back from an engine on the output thread; it stops once it returns to the loop.
+	if (t_onOutputThread)return;
+	g_outputThreadStopped.wait(lock, [] { return !g_outputThreadRunning.load(); });
+}
 
-		if (current_output.speak) {
-			if (current_output.ssml)
-				current_output.engine->SpeakSsml(current_output.text.c_str(), current_output.interrupt);
-			else
-				current_output.engine->Speak(current_output.text.c_str(), current_output.interrupt);
+// Output scheduled with SRAL_SpeakAt bypasses the queue and is fired by its own thread, which sleeps until the next timer is due.
+static Sral::TimerWheel g_timers;
+static std::mutex g_timersMutex;
+static std::condition_variable g_timersCv;
+static std::thread g_timerThread;
+static bool g_timerThreadStop = false;
+// In pump mode, output that came due but did not fit into the budget of SRAL_Pump, in order, from g_pumpDueNext on.
+// Guarded by g_timersMutex.
+static std::vector<Sral::QueuedOutput> g_pumpDue;
+static size_t g_pumpDueNext = 0;
+
+static void fire_scheduled(const Sral::QueuedOutput& output) {
+	SRAL_TRACE_SINCE("queue", "scheduled", output.queuedAt, output.engine->GetNumber());
+	set_in_flight(output);
+	const uint64_t begin = Sral::LatencyTracker::Now();
+	const bool result = output.ssml ? dispatch(output.engine, [&](auto* impl) { return impl->SpeakSsml(output.text.c_str(), output.interrupt); })
+		: dispatch(output.engine, [&](auto* impl) { return impl->Speak(output.text.c_str(), output.interrupt); });
+	output.engine->latency.CallFinished(Sral::LatencyTracker::Now() - begin, result);
+}
 
+static void timer_thread() {
+	std::vector<Sral::QueuedOutput> due;
+	std::unique_lock<std::mutex> lock(g_timersMutex);
+	while (!g_timerThreadStop) {
+		g_timers.Advance(Sral::LatencyTracker::Now(), due);
+		if (!due.empty()) {
+			lock.unlock();
+			for (const Sral::QueuedOutput& output : due) {
+				fire_scheduled(output);
+			}
+			due.clear();
+			lock.lock();
+			continue;
 		}
-		else if (current_output.braille)
-			current_output.engine->Braille(current_output.text.c_str());
+		const uint64_t next = g_timers.NextDue();
+		if (next == 0) g_timersCv.wait(lock);
+		else g_timersCv.wait_until(lock, std::chrono::steady_clock::time_point(std::chrono::microseconds(next)));
+	}
+}
 
+// Fires the next scheduled output that is due, for SRAL_Pump. Returns whether there was one.
+static bool pump_timer(uint64_t now) {
+	Sral::QueuedOutput output;
+	{
+		std::lock_guard<std::mutex> lock(g_timersMutex);
+		if (g_pumpDueNext == g_pumpDue.size()) {
+			g_pumpDue.clear();
+			g_pumpDueNext = 0;
+			g_timers.Advance(now, g_pumpDue);
+			if (g_pumpDue.empty())return false;
+		}
+		output = std::move(g_pumpDue[g_pumpDueNext++]);
 	}
-	g_delayOperation = false;
-	g_lastDelayTime = 0;
-	g_outputThreadRunning.store(false);
+	fire_scheduled(output);
+	return true;
+}
+
+// Removes the due output that SRAL_Pump has yet to fire for which matches returns true. Called with g_timersMutex held.
+template <typename F>
+static size_t cancel_pump_due(F&& matches) {
+	const auto begin = g_pumpDue.begin() + g_pumpDueNext;
+	const auto end = std::remove_if(begin, g_pumpDue.end(), matches);
+	const size_t cancelled = g_pumpDue.end() - end;
+	g_pumpDue.erase(end, g_pumpDue.end());
+	return cancelled;
+}
+
+static void stop_timer_thread() {
+	{
+		std::lock_guard<std::mutex> lock(g_timersMutex);
+		g_timerThreadStop = true;
+		g_timers.Clear();
+		g_pumpDue.clear();
+		g_pumpDueNext = 0;
+	}
+	g_timersCv.notify_one();
+	if (g_timerThread.joinable()) g_timerThread.join();
+	g_timerThreadStop = false;
+}
+
+// Whether text of the given size would take the queue over its limits.
+// A single message larger than the byte limit is still accepted into an empty queue.
+static bool queue_full(size_t bytes) {
+	if (g_queueLimits.maxItems != 0 && g_outputQueue.Size() >= g_queueLimits.maxItems) return true;
+	return g_queueLimits.maxBytes != 0 && !g_outputQueue.Empty() && g_outputQueue.Bytes() + bytes > g_queueLimits.maxBytes;
+}
+
+// Queues output for the output thread, starting it if it is not running.
+// When the queue is full, makes room or drops the output according to the queue policy.
+// Returns the id of the queued output, or 0 if it was dropped.
+static uint64_t queue_output(Sral::QueuedOutput&& output, int channel = Sral::OutputQueue::kNoChannel) {
+	const int ttl = g_outputTtl.load();
+	if (ttl > 0) output.deadline = Sral::LatencyTracker::Now() + static_cast<uint64_t>(ttl) * 1000;
+	output.tag = g_outputTag.load();
+	std::unique_lock<std::mutex> lock(g_outputQueueMutex);
+	g_outputsQueued++;
+	uint64_t id = 0;
+	// Replacing the pending output of a channel does not grow the queue.
+	if ((channel == Sral::OutputQueue::kNoChannel || !g_outputQueue.Pending(channel)) && queue_full(output.text.size())) {
+		const size_t bytes = output.text.size();
+		switch (g_queueLimits.policy) {
+		case SRAL_QUEUE_DROP_NEWEST:
+			SRAL_TRACE_INSTANT("queue", "dropped", 0);
+			g_outputsDropped++;
+			return 0;
+		case SRAL_QUEUE_BLOCK:
+			if (!g_outputQueueSpace.wait_for(lock, std::chrono::milliseconds(g_queueLimits.timeout), [bytes] { return !queue_full(bytes); })) {
+				SRAL_TRACE_INSTANT("queue", "dropped", 0);
+				g_outputsDropped++;
+				return 0;
+			}
+			break;
+		case SRAL_QUEUE_MERGE:
+			if ((g_queueLimits.maxBytes == 0 || g_outputQueue.Bytes() + bytes + 1 <= g_queueLimits.maxBytes) && (id = g_outputQueue.MergeIntoBack(output)) != 0) {
+				g_outputsMerged++;
+				break;
+			}
+			// Output that cannot be merged makes room like SRAL_QUEUE_DROP_OLDEST.
+			[[fallthrough]];
+		default: {
+			Sral::QueuedOutput oldest;
+			while (queue_full(bytes) && g_outputQueue.Pop(oldest)) {
+				SRAL_TRACE_INSTANT("queue", "dropped", 0);
+				g_outputsDropped++;
+			}
+			break;
+		}
+		}
+	}
+	if (id == 0) {
+		bool replaced;
+		id = g_outputQueue.Push(std::move(output), channel, &replaced);
+		if (replaced) {
+			SRAL_TRACE_INSTANT("queue", "replaced", channel);
+			g_outputsReplaced++;
+		}
+	}
+	start_output_thread();
+	g_outputQueueAdded.notify_one();
+	return id;
 }
 
 
@@ -135,7 +623,7 @@ static LRESULT CALLBACK KeyboardHookProc(int nCode, WPARAM wParam, LPARAM lParam
 	if (nCode >= 0) {
 		KBDLLHOOKSTRUCT* pKeyInfo = (KBDLLHOOKSTRUCT*)lParam;
 		for (const auto& [value, ptr] : g_engines) {
-			if (ptr == nullptr || !ptr->GetActive()) continue;
+			if (ptr == nullptr || !(g_enginesReady.load() & value) || !probe_active(ptr)) continue;
 
 			if (wParam == WM_KEYDOWN) {
 				if ((pKeyInfo->vkCode == VK_LCONTROL || pKeyInfo->vkCode == VK_RCONTROL) && ptr->GetKeyFlags() & Sral::HANDLE_INTERRUPT) {
@@ -178,6 +666,14 @@ static void hook_thread() {
 extern "C" SRAL_API bool SRAL_RegisterKeyboardHooks(void) {
 	if (!SRAL_IsInitialized()) return false;
 	if (g_keyboardHookThread.load()) return true;
+	if (Sral::g_pumpMode.load()) {
+		// A low level hook is called on the thread that installed it while that thread retrieves messages,
+		// which the application's own message loop already does.
+		g_keyboardHook = SetWindowsHookEx(WH_KEYBOARD_LL, KeyboardHookProc, GetModuleHandle(NULL), 0);
+		if (g_keyboardHook == nullptr) return false;
+		g_keyboardHookThread.store(true);
+		return true;
+	}
 	g_keyboardHookThread.store(true);
 	g_hookThread = std::thread(hook_thread);
 	g_hookThread.detach();
@@ -193,6 +689,11 @@ extern "C" SRAL_API bool SRAL_RegisterKeyboardHooks(void) {
 
 extern "C" SRAL_API void SRAL_UnregisterKeyboardHooks(void) {
 	if (!SRAL_IsInitialized()) return;
+	if (Sral::g_pumpMode.load()) {
+		if (g_keyboardHookThread.exchange(false)) UnhookWindowsHookEx(g_keyboardHook);
+		g_keyboardHook = nullptr;
+		return;
+	}
 	PostMessage(0, WM_KEYUP, 0, 0);
 	g_keyboardHookThread.store(false);
 	if (g_hookThread.joinable()) {
@@ -211,59 +712,167 @@ extern "C" SRAL_API void SRAL_UnregisterKeyboardHooks(void) {
 
 
 extern "C" SRAL_API void* SRAL_malloc(size_t size) {
-	return malloc(size);
+	return Sral::Allocations::Allocate(size);
+}
+
+extern "C" SRAL_API void* SRAL_realloc(void* memory, size_t size) {
+	if (size == 0) return nullptr;
+	return Sral::Allocations::Reallocate(memory, size);
 }
 
 extern "C" void SRAL_free(void* memory) {
-	free(memory);
+	Sral::Allocations::Free(memory);
+}
+
+extern "C" SRAL_API bool SRAL_SetAllocator(SRAL_AllocFunc alloc, SRAL_ReallocFunc realloc, SRAL_FreeFunc free, void* user_data) {
+	SRAL_RECORD(Sral::Recorder::CALL_SET_ALLOCATOR, 0, false, false, alloc != nullptr, nullptr);
+	return Sral::Allocations::Set(alloc, realloc, free, user_data);
 }
 
 
 
 
+static void initialize_engine(SRAL_Engines value, Sral::Engine* engine, EngineStartup* startup) {
+#if defined(_WIN32) && !defined(SRAL_SEQUENTIAL_STARTUP)
+	CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+#endif
+	SRAL_TRACE_SCOPE("engine", "Initialize", value);
+	const auto begin = std::chrono::steady_clock::now();
+	const bool initialized = engine->Initialize();
+	if (initialized) probe_active(engine);
+	const int64_t time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+	{
+		std::lock_guard<std::mutex> lock(g_startupMutex);
+		startup->time = time;
+		if (initialized)
+			g_enginesReady |= value;
+		else
+			g_enginesFailedToInitialize |= value;
+		g_enginesPending &= ~value;
+	}
+	g_startupCv.notify_all();
+#if defined(_WIN32) && !defined(SRAL_SEQUENTIAL_STARTUP)
+	// The objects created here live on in the MTA, which the thread that called SRAL_Initialize keeps alive.
+	CoUninitialize();
+#endif
+}
+
+static bool wait_for_pending_startup(int mask, int timeout) {
+	SRAL_TRACE_SCOPE("core", "wait_for_startup", mask);
+	std::unique_lock<std::mutex> lock(g_startupMutex);
+	auto done = [mask] { return (g_enginesPending.load() & mask) == SRAL_ENGINE_NONE; };
+	if (timeout < 0) {
+		g_startupCv.wait(lock, done);
+		return true;
+	}
+	return g_startupCv.wait_for(lock, std::chrono::milliseconds(timeout), done);
+}
+
+// Returns false if the engines in the mask were still starting when the timeout (in milliseconds, -1 for none) expired.
+// Kept small so that it is inlined into the *Ex functions, which all go through it.
+static inline bool wait_for_startup(int mask, int timeout) {
+	if ((g_enginesPending.load(std::memory_order_acquire) & mask) == SRAL_ENGINE_NONE) return true;
+	return wait_for_pending_startup(mask, timeout);
+}
+
+static void join_startup_threads() {
+	for (auto& [value, startup] : g_startup) {
+		if (startup.thread.joinable()) {
+			startup.thread.join();
+		}
+	}
+}
+
+template <typename E>
+static void add_engine(SRAL_Engines value) {
+	auto engine = std::make_unique<E>();
+	g_builtinEngines.Register(engine.get());
+	g_engines.Set(value, std::move(engine));
+}
+
 extern "C" SRAL_API bool SRAL_Initialize(int engines_exclude) {
+	return SRAL_InitializeEx(engines_exclude, 0);
+}
+
+extern "C" SRAL_API bool SRAL_InitializeEx(int engines_exclude, int flags) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_INITIALIZE, 0, false, false, engines_exclude, nullptr, &flags);
 	if (g_initialized)return true;
+	// Read by the engines as they start, and by the middleware added later.
+	const bool pump = (flags & SRAL_INIT_PUMP) != 0;
+	Sral::g_pumpMode.store(pump);
 #if defined(_WIN32)
 	CoInitializeEx(nullptr, COINIT_MULTITHREADED);
-	g_engines[SRAL_ENGINE_NVDA] = std::make_unique<Sral::Nvda>();
-	g_engines[SRAL_ENGINE_JAWS] = std::make_unique<Sral::Jaws>();
-	g_engines[SRAL_ENGINE_ZDSR] = std::make_unique<Sral::Zdsr>();
+	add_engine<Sral::Nvda>(SRAL_ENGINE_NVDA);
+	add_engine<Sral::Jaws>(SRAL_ENGINE_JAWS);
+	add_engine<Sral::Zdsr>(SRAL_ENGINE_ZDSR);
 #ifndef SRAL_NO_UIA
-	g_engines[SRAL_ENGINE_UIA] = std::make_unique<Sral::Uia>();
+	add_engine<Sral::Uia>(SRAL_ENGINE_UIA);
 #endif
-	g_engines[SRAL_ENGINE_SAPI] = std::make_unique<Sral::Sapi>();
+	add_engine<Sral::Sapi>(SRAL_ENGINE_SAPI);
 #elif defined(__APPLE__)
-	g_engines[SRAL_ENGINE_VOICE_OVER] = std::make_unique<Sral::VoiceOver>();
-	g_engines[SRAL_ENGINE_AV_SPEECH] = std::make_unique<Sral::AvSpeech>();
+	add_engine<Sral::VoiceOver>(SRAL_ENGINE_VOICE_OVER);
+	add_engine<Sral::AvSpeech>(SRAL_ENGINE_AV_SPEECH);
 #ifndef SRAL_NO_NSSPEECH
-	g_engines[SRAL_ENGINE_NS_SPEECH] = std::make_unique<Sral::NsSpeech>();
+	add_engine<Sral::NsSpeech>(SRAL_ENGINE_NS_SPEECH);
 #endif
 #elif defined(__ANDROID__)
-	g_engines[SRAL_ENGINE_ANDROID_ACCESSIBILITY_MANAGER] = std::make_unique<Sral::AndroidAccessibilityManager>();
-	g_engines[SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH] = std::make_unique<Sral::AndroidTextToSpeech>();
+	add_engine<Sral::AndroidAccessibilityManager>(SRAL_ENGINE_ANDROID_ACCESSIBILITY_MANAGER);
+	add_engine<Sral::AndroidTextToSpeech>(SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH);
+#else
+	add_engine<Sral::SpeechDispatcher>(SRAL_ENGINE_SPEECH_DISPATCHER);
+#endif
+	g_enginesReady.store(SRAL_ENGINE_NONE);
+	g_enginesPending.store(g_engines.Available());
+	for (const auto& [value, ptr] : g_engines) {
+		EngineStartup& startup = g_startup[value];
+#ifdef SRAL_SEQUENTIAL_STARTUP
+		initialize_engine(value, ptr, &startup);
 #else
-	g_engines[SRAL_ENGINE_SPEECH_DISPATCHER] = std::make_unique<Sral::SpeechDispatcher>();
+		if (pump)
+			initialize_engine(value, ptr, &startup);
+		else
+			startup.thread = std::thread(initialize_engine, value, ptr, &startup);
 #endif
+	}
+
 	// Here we need to check that at least one engine has been initialized.
 	// Otherwise, if none of them are running, there is no point in returning true.
-	bool success = false;
-	for (const auto& [value, ptr] : g_engines) {
-		if (!ptr->Initialize()) {
-			g_enginesFailedToInitialize |= ptr->GetNumber();
-		}
-		else {
-			success = true;
-		}
+	// The first one is enough, the others finish in the background and are waited for on first use.
+	{
+		std::unique_lock<std::mutex> lock(g_startupMutex);
+		g_startupCv.wait(lock, [] { return g_enginesReady.load() != SRAL_ENGINE_NONE || g_enginesPending.load() == SRAL_ENGINE_NONE; });
 	}
+	const bool success = g_enginesReady.load() != SRAL_ENGINE_NONE;
 
 	g_initialized = success;
-	if (!g_initialized) return false;
+	if (!g_initialized) {
+		join_startup_threads();
+		g_startup.clear();
+		Sral::g_pumpMode.store(false);
+		return false;
+	}
 	SRAL_SetEnginesExclude(engines_exclude);
 	return g_initialized;
 }
 
 extern "C" SRAL_API void SRAL_Uninitialize(void) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_UNINITIALIZE, 0, false, false, 0, nullptr);
 	if (!SRAL_IsInitialized())return;
+	join_startup_threads();
+	// Scheduled and queued output hold engine pointers, so it is all stopped before any engine goes away.
+	stop_timer_thread();
+	{
+		std::unique_lock<std::mutex> lock(g_outputQueueMutex);
+		g_outputQueue.Clear();
+	}
+	g_outputQueueSpace.notify_all();
+	stop_output_thread();
+	{
+		std::lock_guard<std::mutex> lock(g_inFlightMutex);
+		g_inFlight = InFlightOutput();
+	}
 	for (const auto& [value, ptr] : g_engines) {
 		ptr->Uninitialize();
 	}
@@ -274,22 +883,54 @@ extern "C" SRAL_API void SRAL_Uninitialize(void) {
 	Sral::ClearAndroidContext();
 #endif
 	g_currentEngine = nullptr;
-	g_engines.clear();
+	g_builtinEngines.Clear();
+	g_engines.Clear();
+	Sral::g_activeEngines.store(SRAL_ENGINE_NONE);
 	g_excludes = SRAL_ENGINE_NONE;
 	g_enginesFailedToInitialize = SRAL_ENGINE_NONE;
-	if (g_outputThread.joinable()) {
-		g_outputThread.join();
-	}
+	g_enginesReady.store(SRAL_ENGINE_NONE);
+	g_startup.clear();
 	if (g_keyboardHookThread.load()) {
 		SRAL_UnregisterKeyboardHooks();
 	}
+	{
+		std::lock_guard<std::mutex> lock(g_utteranceCallbackMutex);
+		g_pendingMarks.clear();
+	}
+	g_pumpQuietSince = 0;
+	Sral::g_pumpMode.store(false);
 	g_initialized = false;
 }
 
+namespace Sral {
+	bool InstallEngine(std::unique_ptr<Engine> engine) {
+		if (!engine) return false;
+		const SRAL_Engines number = static_cast<SRAL_Engines>(engine->GetNumber());
+		if (!Sral::EngineRegistry::Valid(number)) return false;
+		// The engine being replaced may still be starting in the background.
+		wait_for_startup(number, -1);
+		if (!engine->Initialize()) return false;
+		if (Sral::Engine* previous = g_engines.Get(number)) {
+			if (g_currentEngine == previous) g_currentEngine = nullptr;
+			previous->Uninitialize();
+			previous->PublishActive(false);
+			g_builtinEngines.Forget(previous);
+		}
+		engine->PublishActive(engine->GetActive());
+		g_engines.Set(number, std::move(engine));
+		g_enginesFailedToInitialize &= ~number;
+		g_enginesReady |= number;
+		g_initialized = true;
+		return true;
+	}
+}
+
 static Sral::Engine* get_engine(int engine) {
-	auto it = g_engines.find(static_cast<SRAL_Engines>(engine));
-	if (it != g_engines.end()) {
-		return it->second.get();
+	Sral::Engine* e = g_engines.Get(engine);
+	if (e != nullptr) {
+		// Explicitly requested engines that are still starting are waited for (lazy initialization).
+		wait_for_startup(engine, -1);
+		return e;
 	}
 	else {
 		return nullptr;
@@ -335,8 +976,73 @@ static BOOL FindProcess(const wchar_t* name) {
 
 
 #endif
+static int64_t steady_ms() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool is_degraded(int engine) {
+	if ((g_enginesDegraded.load() & engine) == SRAL_ENGINE_NONE) return false;
+	std::lock_guard<std::mutex> lock(g_failoverMutex);
+	auto it = g_degradedUntil.find(static_cast<SRAL_Engines>(engine));
+	if (it != g_degradedUntil.end() && steady_ms() < it->second) return true;
+	if (it != g_degradedUntil.end()) g_degradedUntil.erase(it);
+	g_enginesDegraded &= ~engine;
+	return false;
+}
+
+static void mark_degraded(int engine) {
+	std::lock_guard<std::mutex> lock(g_failoverMutex);
+	g_degradedUntil[static_cast<SRAL_Engines>(engine)] = steady_ms() + g_failover.cooldown;
+	g_enginesDegraded |= engine;
+	g_failoverDegraded++;
+}
+
+// Whether automatic engine selection may pick this engine.
+static bool engine_eligible(SRAL_Engines value, Sral::Engine* engine) {
+	return (g_enginesReady.load() & value) && !(g_excludes & value) && !is_degraded(value) && probe_active(engine);
+}
+
+// Lists the engines in the order automatic selection tries them:
+// pinned engines first, then the rest in map order or, with adaptive selection, best score first.
+static void rank_engines(std::vector<Sral::Engine*>& ranked) {
+	ranked.clear();
+	int pinned = SRAL_ENGINE_NONE;
+	{
+		std::lock_guard<std::mutex> lock(g_selectionMutex);
+		for (SRAL_Engines value : g_priority) {
+			Sral::Engine* engine = g_engines.Get(value);
+			if (engine == nullptr) continue;
+			ranked.push_back(engine);
+			pinned |= value;
+		}
+	}
+	const size_t first = ranked.size();
+	for (const auto& [value, ptr] : g_engines) {
+		if (!(pinned & value)) ranked.push_back(ptr);
+	}
+	if (!g_adaptiveSelection.load()) return;
+	thread_local std::vector<std::pair<double, Sral::Engine*>> scored;
+	scored.clear();
+	for (size_t i = first; i < ranked.size(); ++i) {
+		scored.emplace_back(ranked[i]->latency.Score(), ranked[i]);
+	}
+	// A stable insertion sort: there are only a few engines, and std::stable_sort allocates a buffer on every call.
+	for (size_t i = 1; i < scored.size(); ++i) {
+		const auto item = scored[i];
+		size_t j = i;
+		for (; j > 0 && item.first < scored[j - 1].first; --j) scored[j] = scored[j - 1];
+		scored[j] = item;
+	}
+	for (size_t i = 0; i < scored.size(); ++i) {
+		ranked[first + i] = scored[i].second;
+	}
+}
+
 static void speech_engine_update() {
-	if (!g_currentEngine || !g_currentEngine->GetActive() || g_currentEngine->GetNumber() == SRAL_ENGINE_SAPI || g_currentEngine->GetNumber() == SRAL_ENGINE_UIA || g_currentEngine->GetNumber() == SRAL_ENGINE_AV_SPEECH || g_currentEngine->GetNumber() == SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH) {
+	SRAL_TRACE_SCOPE("core", "speech_engine_update", 0);
+	// With a custom order the best engine can change at any time, so it is re-evaluated on every call.
+	const bool customOrder = g_adaptiveSelection.load() || g_priorityPinned.load();
+	if (customOrder || !g_currentEngine || !probe_active(g_currentEngine) || is_degraded(g_currentEngine->GetNumber()) || g_currentEngine->GetNumber() == SRAL_ENGINE_SAPI || g_currentEngine->GetNumber() == SRAL_ENGINE_UIA || g_currentEngine->GetNumber() == SRAL_ENGINE_AV_SPEECH || g_currentEngine->GetNumber() == SRAL_ENGINE_ANDROID_TEXT_TO_SPEECH) {
 #if defined(_WIN32) && !defined(SRAL_NO_UIA)
 		if (FindProcess(L"narrator.exe") == TRUE) {
 			g_currentEngine = get_engine(SRAL_ENGINE_UIA);
@@ -344,11 +1050,21 @@ static void speech_engine_update() {
 		}
 		else {
 #endif
-			for (const auto& [value, ptr] : g_engines) {
-				if (ptr->GetActive() && !(g_excludes & value)) {
-					g_currentEngine = ptr.get();
-					break;
+			thread_local std::vector<Sral::Engine*> ranked;
+			for (;;) {
+				const int pending = g_enginesPending.load();
+				rank_engines(ranked);
+				for (Sral::Engine* engine : ranked) {
+					if (engine_eligible(static_cast<SRAL_Engines>(engine->GetNumber()), engine)) {
+						g_currentEngine = engine;
+						break;
+					}
 				}
+				if (g_currentEngine && probe_active(g_currentEngine) && !is_degraded(g_currentEngine->GetNumber())) break;
+				if (pending == SRAL_ENGINE_NONE) break;
+				// Nothing usable has started yet; wait for the next engine to finish and look again.
+				std::unique_lock<std::mutex> lock(g_startupMutex);
+				g_startupCv.wait(lock, [pending] { return g_enginesPending.load() != pending; });
 			}
 #if defined(_WIN32) && !defined(SRAL_NO_UIA)
 		}
@@ -356,61 +1072,203 @@ static void speech_engine_update() {
 	}
 }
 
+// Performs an output call on the current engine. If that fails and failover is enabled, the engine is
+// marked degraded and the call is retried on the other eligible engines with the required feature.
+// Empty text is rejected by some engines; that says nothing about the engine, so it never fails over.
+template <typename Call>
+static bool output_with_failover(int feature, const char* text, Call&& call) {
+	Sral::Engine* first = g_currentEngine;
+	if (call(first->GetNumber())) return true;
+	if (text == nullptr || *text == '\0') return false;
+
+	FailoverPolicy policy;
+	{
+		std::lock_guard<std::mutex> lock(g_failoverMutex);
+		policy = g_failover;
+	}
+	if (!policy.enabled) return false;
+	SRAL_TRACE_SCOPE("core", "failover", first->GetNumber());
+	g_failoverFailures++;
+	mark_degraded(first->GetNumber());
+	const int64_t deadline = steady_ms() + policy.budget;
+	for (const auto& [value, ptr] : g_engines) {
+		if (steady_ms() >= deadline) break;
+		if (ptr == first || !(ptr->GetFeatures() & feature) || !engine_eligible(value, ptr)) continue;
+		if (call(value)) {
+			g_currentEngine = ptr;
+			g_failoverSucceeded++;
+			return true;
+		}
+		mark_degraded(value);
+	}
+	g_failoverExhausted++;
+	return false;
+}
+
 extern "C" SRAL_API bool SRAL_Speak(const char* text, bool interrupt) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_SPEAK, 0, false, interrupt, 0, text);
 	speech_engine_update();
 	if (g_currentEngine == nullptr)		return false;
-	return SRAL_SpeakEx(g_currentEngine->GetNumber(), text, interrupt);
+	return output_with_failover(SRAL_SUPPORTS_SPEECH, text, [&](int engine) { return SRAL_SpeakEx(engine, text, interrupt); });
 }
 
 extern "C" SRAL_API void* SRAL_SpeakToMemory(const char* text, uint64_t* buffer_size, int* channels, int* sample_rate, int* bits_per_sample) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_SPEAK_TO_MEMORY, 0, false, false, 0, text);
 	speech_engine_update();
 	if (g_currentEngine == nullptr)		return nullptr;
 	return SRAL_SpeakToMemoryEx(g_currentEngine->GetNumber(), text, buffer_size, channels, sample_rate, bits_per_sample);
 }
 
 extern "C" SRAL_API bool SRAL_SpeakSsml(const char* ssml, bool interrupt) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_SPEAK_SSML, 0, false, interrupt, 0, ssml);
 	speech_engine_update();
 	if (g_currentEngine == nullptr)		return false;
-	return SRAL_SpeakSsmlEx(g_currentEngine->GetNumber(), ssml, interrupt);
+	return output_with_failover(SRAL_SUPPORTS_SSML, ssml, [&](int engine) { return SRAL_SpeakSsmlEx(engine, ssml, interrupt); });
 }
 
 extern "C" SRAL_API bool SRAL_Braille(const char* text) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_BRAILLE, 0, false, false, 0, text);
 	speech_engine_update();
 	if (g_currentEngine == nullptr)return false;
-	return SRAL_BrailleEx(g_currentEngine->GetNumber(), text);
+	return output_with_failover(SRAL_SUPPORTS_BRAILLE, text, [&](int engine) { return SRAL_BrailleEx(engine, text); });
+}
+
+// The argument block of a recorded SpeakWithParams call: flags, rate, volume and voice index, without the padding
+// of the struct. Interrupt is recorded as a flag of the call.
+static std::array<int32_t, 4> recorded_params(const SRAL_UtteranceParams* params) {
+	if (params == nullptr)return {};
+	return { params->flags, params->rate, params->volume, params->voice_index };
+}
+
+extern "C" SRAL_API bool SRAL_SpeakWithParams(const char* text, const SRAL_UtteranceParams* params) {
+	SRAL_TRACE_API();
+	const auto args = recorded_params(params);
+	SRAL_RECORD(Sral::Recorder::CALL_SPEAK_WITH_PARAMS, 0, false, params && params->interrupt, 0, text, nullptr, params ? args.data() : nullptr, sizeof(args));
+	if (text == nullptr || params == nullptr)return false;
+	speech_engine_update();
+	if (g_currentEngine == nullptr)		return false;
+	return output_with_failover(SRAL_SUPPORTS_SPEECH, text, [&](int engine) { return SRAL_SpeakWithParamsEx(engine, text, params); });
+}
+
+extern "C" SRAL_API uint64_t SRAL_SpeakOnChannel(int channel_id, const char* text, int flags) {
+	SRAL_TRACE_API();
+	Sral::Recorder::Guard record(Sral::Recorder::CALL_SPEAK_ON_CHANNEL, 0, false, (flags & SRAL_OUTPUT_INTERRUPT) != 0, channel_id, text, &flags);
+	if (channel_id < 0 || text == nullptr)return 0;
+	speech_engine_update();
+	if (g_currentEngine == nullptr)return 0;
+	const bool ssml = (flags & SRAL_OUTPUT_SSML) != 0;
+	if (!(g_currentEngine->GetFeatures() & (ssml ? SRAL_SUPPORTS_SSML : SRAL_SUPPORTS_SPEECH)))return 0;
+	Sral::QueuedOutput qout;
+	qout.text = std::string(text);
+	qout.interrupt = (flags & SRAL_OUTPUT_INTERRUPT) != 0;
+	qout.speak = true;
+	qout.ssml = ssml;
+	qout.engine = g_currentEngine;
+	qout.time = g_lastDelayTime;
+	qout.queuedAt = SRAL_TRACE_NOW();
+	return record.Returned(queue_output(std::move(qout), channel_id));
+}
+
+extern "C" SRAL_API uint64_t SRAL_GetMonotonicTime(void) {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+extern "C" SRAL_API uint64_t SRAL_SpeakAt(int engine, const char* text, uint64_t monotonic_deadline_ns, int flags) {
+	SRAL_TRACE_API();
+	// Recorded as a delay, since the clock of a replay starts elsewhere.
+	uint64_t delay = 0;
+	if (Sral::Recorder::Active()) {
+		const uint64_t called = SRAL_GetMonotonicTime();
+		delay = monotonic_deadline_ns > called ? monotonic_deadline_ns - called : 0;
+	}
+	Sral::Recorder::Guard record(Sral::Recorder::CALL_SPEAK_AT, engine, engine != 0, (flags & SRAL_OUTPUT_INTERRUPT) != 0, 0, text, &flags, &delay, sizeof(delay));
+	if (text == nullptr)return 0;
+	Sral::Engine* e = nullptr;
+	if (engine == 0) {
+		speech_engine_update();
+		e = g_currentEngine;
+	}
+	else {
+		e = get_engine(engine);
+	}
+	if (e == nullptr)return 0;
+	const bool ssml = (flags & SRAL_OUTPUT_SSML) != 0;
+	if (!(e->GetFeatures() & (ssml ? SRAL_SUPPORTS_SSML : SRAL_SUPPORTS_SPEECH)))return 0;
+	Sral::QueuedOutput output;
+	output.text = std::string(text);
+	output.interrupt = (flags & SRAL_OUTPUT_INTERRUPT) != 0;
+	output.speak = true;
+	output.ssml = ssml;
+	output.engine = e;
+	output.queuedAt = SRAL_TRACE_NOW();
+	output.tag = g_outputTag.load();
+	const uint64_t now = Sral::LatencyTracker::Now();
+	const uint64_t due = (monotonic_deadline_ns + 999) / 1000;
+	uint64_t id;
+	bool wake;
+	{
+		std::lock_guard<std::mutex> lock(g_timersMutex);
+		const uint64_t next = g_timers.NextDue();
+		id = g_timers.Add(now, due, std::move(output));
+		wake = next == 0 || g_timers.NextDue() < next;
+		if (!Sral::g_pumpMode.load() && !g_timerThread.joinable()) g_timerThread = std::thread(timer_thread);
+	}
+	if (wake) g_timersCv.notify_one();
+	return record.Returned(id);
+}
+
+extern "C" SRAL_API uint64_t SRAL_SpeakAfter(int engine, const char* text, uint64_t delay_ns, int flags) {
+	Sral::Recorder::Guard record(Sral::Recorder::CALL_SPEAK_AFTER, engine, engine != 0, (flags & SRAL_OUTPUT_INTERRUPT) != 0, 0, text, &flags, &delay_ns, sizeof(delay_ns));
+	return record.Returned(SRAL_SpeakAt(engine, text, SRAL_GetMonotonicTime() + delay_ns, flags));
 }
 
 extern "C" SRAL_API bool SRAL_Output(const char* text, bool interrupt) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_OUTPUT, 0, false, interrupt, 0, text);
 	speech_engine_update();
 	if (g_currentEngine == nullptr)return false;
-	return SRAL_OutputEx(g_currentEngine->GetNumber(), text, interrupt);
+	return output_with_failover(SRAL_SUPPORTS_SPEECH | SRAL_SUPPORTS_BRAILLE, text, [&](int engine) { return SRAL_OutputEx(engine, text, interrupt); });
 }
 
 extern "C" SRAL_API bool SRAL_StopSpeech(void) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_STOP_SPEECH, 0, false, false, 0, nullptr);
 	speech_engine_update();
 	if (g_currentEngine == nullptr)return false;
 	return SRAL_StopSpeechEx(g_currentEngine->GetNumber());
 }
 
 extern "C" SRAL_API bool SRAL_PauseSpeech(void) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_PAUSE_SPEECH, 0, false, false, 0, nullptr);
 	speech_engine_update();
 	if (g_currentEngine == nullptr)return false;
 	return SRAL_PauseSpeechEx(g_currentEngine->GetNumber());
 }
 
 extern "C" SRAL_API bool SRAL_ResumeSpeech(void) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_RESUME_SPEECH, 0, false, false, 0, nullptr);
 	speech_engine_update();
 	if (g_currentEngine == nullptr)return false;
 	return SRAL_ResumeSpeechEx(g_currentEngine->GetNumber());
 }
 
 extern "C" SRAL_API bool SRAL_IsSpeaking(void) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_IS_SPEAKING, 0, false, false, 0, nullptr);
 	speech_engine_update();
 	if (g_currentEngine == nullptr)		return false;
 	return SRAL_IsSpeakingEx(g_currentEngine->GetNumber());
 }
 
 extern "C" SRAL_API int SRAL_GetCurrentEngine(void) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_GET_CURRENT_ENGINE, 0, false, false, 0, nullptr);
 	speech_engine_update();
 	if (g_currentEngine == nullptr)return SRAL_ENGINE_NONE;
 	return g_currentEngine->GetNumber();
@@ -431,7 +1289,32 @@ extern "C" SRAL_API int SRAL_GetEngineFeatures(int engine) {
 
 
 
+static Sral::Engine* parameter_engine(int engine) {
+	return engine == 0 && g_currentEngine != nullptr ? g_currentEngine : get_engine(engine);
+}
+
+static const void* param_value(const SRAL_ParamValue& v) {
+	return v.type == SRAL_PARAM_TYPE_BOOL ? static_cast<const void*>(&v.value.bool_value) : &v.value.int_value;
+}
+
+static void update_shadow(Sral::Engine* e, int param, const void* value, bool applied) {
+	if (applied)
+		e->shadow.Set(param, value);
+	else
+		e->shadow.Invalidate(param);
+}
+
+static bool get_parameter(Sral::Engine* e, int param, void* value) {
+	if (e->shadow.Get(param, value))return true;
+	SRAL_TRACE_SCOPE("engine", "GetParameter", param);
+	const bool result = dispatch(e, [&](auto* impl) { return impl->GetParameter(param, value); });
+	if (result) e->shadow.Store(param, value);
+	return result;
+}
+
 extern "C" SRAL_API bool SRAL_SetEngineParameter(int engine, int param, const void* value) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_SET_ENGINE_PARAMETER, engine, engine != 0, false, param, nullptr, value);
 #ifdef __ANDROID__
 	// Android platform bootstrap params may be set before SRAL_Initialize,
 	// so they are handled here directly rather than dispatching to an engine.
@@ -442,184 +1325,287 @@ extern "C" SRAL_API bool SRAL_SetEngineParameter(int engine, int param, const vo
 		return Sral::SetAndroidActivity((jobject)const_cast<void*>(value));
 	}
 #endif
-	if (engine == 0 && g_currentEngine != nullptr) {
-		return g_currentEngine->SetParameter(param, value);
-	}
-	Sral::Engine* e = get_engine(engine);
+	Sral::Engine* e = parameter_engine(engine);
 	if (e == nullptr)return false;
-	return e->SetParameter(param, value);
+	// Settings UIs set the same value over and over while a slider is dragged.
+	if (e->shadow.Matches(param, value))return true;
+	SRAL_TRACE_SCOPE("engine", "SetParameter", param);
+	const bool result = dispatch(e, [&](auto* impl) { return impl->SetParameter(param, value); });
+	update_shadow(e, param, value, result);
+	return result;
 }
 
 
 extern "C" SRAL_API bool SRAL_GetEngineParameter(int engine, int param, void* value) {
-	if (engine == 0 && g_currentEngine != nullptr) {
-		return g_currentEngine->GetParameter(param, value);
-	}
-	Sral::Engine* e = get_engine(engine);
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_GET_ENGINE_PARAMETER, engine, engine != 0, false, param, nullptr);
+	Sral::Engine* e = parameter_engine(engine);
 	if (e == nullptr)return false;
-	return e->GetParameter(param, value);
+	return get_parameter(e, param, value);
+}
+
+// The argument block of a recorded SetEngineParameters or GetEngineParameters call, as int32_t: the parameter, type
+// and value of each entry, or only the parameter for GetEngineParameters, whose values are results. Only built while
+// recording, in a buffer that is reused.
+static const std::vector<int32_t>& recorded_values(const SRAL_ParamValue* values, int count, bool withValues) {
+	thread_local std::vector<int32_t> block;
+	block.clear();
+	if (values == nullptr || !Sral::Recorder::Active())return block;
+	for (int i = 0; i < count; ++i) {
+		const SRAL_ParamValue& v = values[i];
+		block.push_back(v.param);
+		if (!withValues)continue;
+		block.push_back(v.type);
+		block.push_back(v.type == SRAL_PARAM_TYPE_BOOL ? v.value.bool_value : v.value.int_value);
+	}
+	return block;
+}
+
+extern "C" SRAL_API int SRAL_SetEngineParameters(int engine, const SRAL_ParamValue* values, int count) {
+	SRAL_TRACE_API();
+	const std::vector<int32_t>& block = recorded_values(values, count, true);
+	SRAL_RECORD(Sral::Recorder::CALL_SET_ENGINE_PARAMETERS, engine, engine != 0, false, count, nullptr, nullptr, block.data(), static_cast<uint32_t>(block.size() * sizeof(int32_t)));
+	if (values == nullptr || count <= 0)return 0;
+	Sral::Engine* e = parameter_engine(engine);
+	if (e == nullptr)return 0;
+	// Only the values that would change something go to the engine, in one call. A new voice may reset the
+	// others, so a batch that changes the voice sends everything.
+	bool voiceChange = false;
+	for (int i = 0; i < count; ++i) {
+		const SRAL_ParamValue& v = values[i];
+		if (v.param == SRAL_PARAM_VOICE_INDEX && v.type == SRAL_PARAM_TYPE_INT && !e->shadow.Matches(v.param, param_value(v))) voiceChange = true;
+	}
+	std::vector<SRAL_ParamValue> changed;
+	int applied = 0;
+	for (int i = 0; i < count; ++i) {
+		const SRAL_ParamValue& v = values[i];
+		if (v.type == SRAL_PARAM_TYPE_NONE || v.type != Sral::ParameterType(v.param))continue;
+		if (!voiceChange && e->shadow.Matches(v.param, param_value(v)))
+			applied++;
+		else
+			changed.push_back(v);
+	}
+	if (changed.empty())return applied;
+	std::unique_ptr<bool[]> results(new bool[changed.size()]());
+	{
+		SRAL_TRACE_SCOPE("engine", "SetParameters", static_cast<int>(changed.size()));
+		dispatch(e, [&](auto* impl) { impl->SetParameters(changed.data(), changed.size(), results.get()); });
+	}
+	// In the order they were applied, so that the voice resets the rest first.
+	for (int pass = 0; pass < 2; ++pass) {
+		for (size_t i = 0; i < changed.size(); ++i) {
+			if ((changed[i].param == SRAL_PARAM_VOICE_INDEX) != (pass == 0))continue;
+			update_shadow(e, changed[i].param, param_value(changed[i]), results[i]);
+			if (results[i]) applied++;
+		}
+	}
+	return applied;
+}
+
+extern "C" SRAL_API int SRAL_GetEngineParameters(int engine, SRAL_ParamValue* values, int count) {
+	SRAL_TRACE_API();
+	const std::vector<int32_t>& block = recorded_values(values, count, false);
+	SRAL_RECORD(Sral::Recorder::CALL_GET_ENGINE_PARAMETERS, engine, engine != 0, false, count, nullptr, nullptr, block.data(), static_cast<uint32_t>(block.size() * sizeof(int32_t)));
+	if (values == nullptr || count <= 0)return 0;
+	Sral::Engine* e = parameter_engine(engine);
+	int read = 0;
+	for (int i = 0; i < count; ++i) {
+		SRAL_ParamValue& v = values[i];
+		v.type = Sral::ParameterType(v.param);
+		void* value = v.type == SRAL_PARAM_TYPE_BOOL ? static_cast<void*>(&v.value.bool_value) : &v.value.int_value;
+		if (e == nullptr || v.type == SRAL_PARAM_TYPE_NONE || !get_parameter(e, v.param, value)) {
+			v.type = SRAL_PARAM_TYPE_NONE;
+			continue;
+		}
+		read++;
+	}
+	return read;
 }
 
 
 
 extern "C" SRAL_API bool SRAL_SpeakEx(int engine, const char* text, bool interrupt) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_SPEAK, engine, true, interrupt, 0, text);
 	Sral::Engine* e = get_engine(engine);
 	if (e == nullptr)return false;
-	if (!g_delayOperation.load())
-		return e->Speak(text, interrupt);
+	if (!g_delayOperation.load()) {
+		SRAL_TRACE_SCOPE("engine", "Speak", engine);
+		const uint64_t begin = Sral::LatencyTracker::Now();
+		const bool result = dispatch(e, [&](auto* impl) { return impl->Speak(text, interrupt); });
+		e->latency.CallFinished(Sral::LatencyTracker::Now() - begin, result);
+		return result;
+	}
 	else {
-		QueuedOutput qout;
+		Sral::QueuedOutput qout;
 		qout.text = std::string(text);
 		qout.interrupt = interrupt;
-		qout.braille = false;
 		qout.speak = true;
 		qout.ssml = false;
 		qout.engine = e;
 		qout.time = g_lastDelayTime;
-		{
-			std::unique_lock<std::mutex> lock(g_delayedOutputsMutex);
-			g_delayedOutputs.push_back(qout);
-		}
-		if (!g_outputThreadRunning) {
-			g_outputThread = std::thread(output_thread);
-			g_outputThread.detach();
-		}
-		return true;
+		qout.queuedAt = SRAL_TRACE_NOW();
+		return queue_output(std::move(qout)) != 0;
 	}
 	return false;
 }
 
 extern "C" SRAL_API void* SRAL_SpeakToMemoryEx(int engine, const char* text, uint64_t* buffer_size, int* channels, int* sample_rate, int* bits_per_sample) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_SPEAK_TO_MEMORY, engine, true, false, 0, text);
 	Sral::Engine* e = get_engine(engine);
 	if (e == nullptr)return nullptr;
-	return e->SpeakToMemory(text, buffer_size, channels, sample_rate, bits_per_sample);
+	SRAL_TRACE_SCOPE("engine", "SpeakToMemory", engine);
+	return dispatch(e, [&](auto* impl) { return impl->SpeakToMemory(text, buffer_size, channels, sample_rate, bits_per_sample); });
 }
 
 extern "C" SRAL_API bool SRAL_SpeakSsmlEx(int engine, const char* ssml, bool interrupt) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_SPEAK_SSML, engine, true, interrupt, 0, ssml);
 	Sral::Engine* e = get_engine(engine);
 	if (e == nullptr)return false;
-	if (!g_delayOperation.load())
-		return e->SpeakSsml(ssml, interrupt);
+	if (!g_delayOperation.load()) {
+		SRAL_TRACE_SCOPE("engine", "SpeakSsml", engine);
+		const uint64_t begin = Sral::LatencyTracker::Now();
+		const bool result = dispatch(e, [&](auto* impl) { return impl->SpeakSsml(ssml, interrupt); });
+		e->latency.CallFinished(Sral::LatencyTracker::Now() - begin, result);
+		return result;
+	}
 	else {
-		QueuedOutput qout;
+		Sral::QueuedOutput qout;
 		qout.text = std::string(ssml);
 		qout.interrupt = interrupt;
-		qout.braille = false;
 		qout.speak = true;
 		qout.ssml = true;
 		qout.engine = e;
 		qout.time = g_lastDelayTime;
-		{
-			std::unique_lock<std::mutex> lock(g_delayedOutputsMutex);
-			g_delayedOutputs.push_back(qout);
-		}
-		if (!g_outputThreadRunning) {
-			g_outputThread = std::thread(output_thread);
-			g_outputThread.detach();
-		}
-		return true;
+		qout.queuedAt = SRAL_TRACE_NOW();
+		return queue_output(std::move(qout)) != 0;
 	}
 	return false;
 }
 
+extern "C" SRAL_API bool SRAL_SpeakWithParamsEx(int engine, const char* text, const SRAL_UtteranceParams* params) {
+	SRAL_TRACE_API();
+	const auto args = recorded_params(params);
+	SRAL_RECORD(Sral::Recorder::CALL_SPEAK_WITH_PARAMS, engine, true, params && params->interrupt, 0, text, nullptr, params ? args.data() : nullptr, sizeof(args));
+	if (text == nullptr || params == nullptr)return false;
+	Sral::Engine* e = get_engine(engine);
+	if (e == nullptr)return false;
+	if (!g_delayOperation.load()) {
+		SRAL_TRACE_SCOPE("engine", "SpeakWithParams", engine);
+		const uint64_t begin = Sral::LatencyTracker::Now();
+		const bool result = dispatch(e, [&](auto* impl) { return impl->SpeakWithParams(text, params->interrupt, *params); });
+		e->latency.CallFinished(Sral::LatencyTracker::Now() - begin, result);
+		return result;
+	}
+	Sral::QueuedOutput qout;
+	qout.text = std::string(text);
+	qout.interrupt = params->interrupt;
+	qout.speak = true;
+	qout.params = *params;
+	qout.engine = e;
+	qout.time = g_lastDelayTime;
+	qout.queuedAt = SRAL_TRACE_NOW();
+	return queue_output(std::move(qout)) != 0;
+}
+
 extern "C" SRAL_API bool SRAL_BrailleEx(int engine, const char* text) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_BRAILLE, engine, true, false, 0, text);
 	Sral::Engine* e = get_engine(engine);
 	if (e == nullptr)return false;
-	return e->Braille(text);
+	SRAL_TRACE_SCOPE("engine", "Braille", engine);
+	return dispatch(e, [&](auto* impl) { return impl->Braille(text); });
 }
 
 extern "C" SRAL_API bool SRAL_OutputEx(int engine, const char* text, bool interrupt) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_OUTPUT, engine, true, interrupt, 0, text);
 	Sral::Engine* e = get_engine(engine);
 	if (e == nullptr)return false;
-	const bool speech = e->Speak(text, interrupt);
-	const bool braille = e->Braille(text);
+	SRAL_TRACE_SCOPE("engine", "Output", engine);
+	const bool speech = dispatch(e, [&](auto* impl) { return impl->Speak(text, interrupt); });
+	const bool braille = dispatch(e, [&](auto* impl) { return impl->Braille(text); });
 	return speech || braille;
 }
 
 extern "C" SRAL_API bool SRAL_StopSpeechEx(int engine) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_STOP_SPEECH, engine, true, false, 0, nullptr);
 	Sral::Engine* e = get_engine(engine);
 	if (e == nullptr)return false;
 	if (g_delayOperation.load()) {
 		{
-			std::unique_lock<std::mutex> lock(g_delayedOutputsMutex);
-			g_delayedOutputs.clear();
-		}
-		g_delayOperation.store(false);
-		if (g_outputThread.joinable()) {
-			g_outputThread.join();
+			std::unique_lock<std::mutex> lock(g_outputQueueMutex);
+			g_outputQueue.Clear();
 		}
+		g_outputQueueSpace.notify_all();
+		stop_output_thread();
 	}
-	return e->StopSpeech();
+	SRAL_TRACE_SCOPE("engine", "StopSpeech", engine);
+	return dispatch(e, [](auto* impl) { return impl->StopSpeech(); });
 }
 
 
 extern "C" SRAL_API bool SRAL_PauseSpeechEx(int engine) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_PAUSE_SPEECH, engine, true, false, 0, nullptr);
 	Sral::Engine* e = get_engine(engine);
 	if (e == nullptr)return false;
-	if (g_delayOperation.load()) {
-		g_delayOperation.store(false);
-		if (g_outputThread.joinable()) {
-			g_outputThread.join();
-		}
-	}
-	return e->PauseSpeech();
+	if (g_delayOperation.load()) stop_output_thread();
+	SRAL_TRACE_SCOPE("engine", "PauseSpeech", engine);
+	return dispatch(e, [](auto* impl) { return impl->PauseSpeech(); });
 }
 
 
 
 extern "C" SRAL_API bool SRAL_ResumeSpeechEx(int engine) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_RESUME_SPEECH, engine, true, false, 0, nullptr);
 	Sral::Engine* e = get_engine(engine);
 	if (e == nullptr)return false;
 	{
-		std::unique_lock<std::mutex> lock(g_delayedOutputsMutex);
-		if (!g_delayedOutputs.empty()) {
-			g_delayOperation.store(true);
-			if (!g_outputThreadRunning) {
-				g_outputThread = std::thread(output_thread);
-				g_outputThread.detach();
-			}
-		}
+		std::unique_lock<std::mutex> lock(g_outputQueueMutex);
+		if (!g_outputQueue.Empty()) start_output_thread();
 	}
-	return e->ResumeSpeech();
+	SRAL_TRACE_SCOPE("engine", "ResumeSpeech", engine);
+	return dispatch(e, [](auto* impl) { return impl->ResumeSpeech(); });
 }
 
 
 extern "C" SRAL_API bool SRAL_IsSpeakingEx(int engine) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_IS_SPEAKING, engine, true, false, 0, nullptr);
 	Sral::Engine* e = get_engine(engine);
 	if (e == nullptr)return false;
-	return e->IsSpeaking();
+	SRAL_TRACE_SCOPE("engine", "IsSpeaking", engine);
+	return dispatch(e, [](auto* impl) { return impl->IsSpeaking(); });
 }
 
 extern "C" SRAL_API bool SRAL_IsInitialized(void) {
-	return g_initialized && !g_engines.empty();
+	return g_initialized && !g_engines.Empty();
 }
 
 
 
 extern "C" SRAL_API void SRAL_Delay(int time) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_DELAY, 0, false, false, time, nullptr);
 	if (!SRAL_IsInitialized()) return;
 	g_lastDelayTime = time;
 	g_delayOperation.store(true);
 }
 
 extern "C" SRAL_API int SRAL_GetAvailableEngines(void) {
-	if (g_engines.empty())return 0;
-	int mask = 0;
-	for (const auto& [value, ptr] : g_engines) {
-		if (ptr)
-			mask |= value;
-	}
-	return mask;
+	return g_engines.Available();
 }
 
 extern "C" SRAL_API int SRAL_GetActiveEngines(void) {
-	if (g_engines.empty())return 0;
-	int mask = 0;
-	for (const auto& [value, ptr] : g_engines) {
-		if (ptr && ptr->GetActive())
-			mask |= value;
-	}
-	return mask;
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_GET_ACTIVE_ENGINES, 0, false, false, 0, nullptr);
+	// The engines keep the active mask current; asking them here could mean a round trip to a screen reader.
+	return Sral::g_activeEngines.load() & g_enginesReady.load() & g_engines.Available();
 }
 
 
@@ -643,6 +1629,8 @@ extern "C" SRAL_API const char* SRAL_GetEngineName(int engine) {
 }
 
 extern "C" SRAL_API bool SRAL_SetEnginesExclude(int engines_exclude) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_SET_ENGINES_EXCLUDE, 0, false, false, engines_exclude, nullptr);
 	if (!SRAL_IsInitialized()) return false;
 	g_excludes = engines_exclude;
 	speech_engine_update();
@@ -652,3 +1640,318 @@ extern "C" SRAL_API bool SRAL_SetEnginesExclude(int engines_exclude) {
 extern "C" SRAL_API int SRAL_GetEnginesExclude(void) {
 	return SRAL_IsInitialized() ? g_excludes : -1;
 }
+
+extern "C" SRAL_API bool SRAL_GetLatencyStats(int engine, SRAL_LatencyStats* stats) {
+	if (stats == nullptr)return false;
+	Sral::Engine* e = engine == 0 ? g_currentEngine : get_engine(engine);
+	if (e == nullptr)return false;
+	e->latency.Export(stats);
+	return true;
+}
+
+extern "C" SRAL_API void SRAL_ResetLatencyStats(int engine) {
+	Sral::Engine* e = engine == 0 ? g_currentEngine : get_engine(engine);
+	if (e == nullptr)return;
+	e->latency.Reset();
+}
+
+extern "C" SRAL_API bool SRAL_SetTracing(bool enable) {
+	return Sral::Trace::SetEnabled(enable);
+}
+
+extern "C" SRAL_API bool SRAL_DumpTrace(const char* path) {
+	return Sral::Trace::Dump(path);
+}
+
+extern "C" SRAL_API bool SRAL_GetAllocationCount(uint64_t* count) {
+	if (count == nullptr) return false;
+	return Sral::Allocations::Count(count);
+}
+
+extern "C" SRAL_API bool SRAL_StartRecording(const char* path) {
+	return Sral::Recorder::Start(path);
+}
+
+extern "C" SRAL_API void SRAL_StopRecording(void) {
+	Sral::Recorder::Stop();
+}
+
+extern "C" SRAL_API bool SRAL_WaitForEngines(int timeout) {
+	SRAL_TRACE_API();
+	return wait_for_startup(~SRAL_ENGINE_NONE, timeout);
+}
+
+extern "C" SRAL_API int64_t SRAL_GetEngineStartupTime(int engine) {
+	std::lock_guard<std::mutex> lock(g_startupMutex);
+	auto it = g_startup.find(static_cast<SRAL_Engines>(engine));
+	if (it == g_startup.end())return -1;
+	return it->second.time;
+}
+
+extern "C" SRAL_API void SRAL_SetFailoverPolicy(bool enabled, int budget_ms, int cooldown_ms) {
+	const int32_t args[] = { enabled, budget_ms, cooldown_ms };
+	SRAL_RECORD(Sral::Recorder::CALL_SET_FAILOVER_POLICY, 0, false, false, 0, nullptr, nullptr, args, sizeof(args));
+	std::lock_guard<std::mutex> lock(g_failoverMutex);
+	g_failover.enabled = enabled;
+	g_failover.budget = budget_ms < 0 ? 0 : budget_ms;
+	g_failover.cooldown = cooldown_ms < 0 ? 0 : cooldown_ms;
+}
+
+extern "C" SRAL_API bool SRAL_GetFailoverStats(SRAL_FailoverStats* stats) {
+	if (stats == nullptr)return false;
+	stats->failures = g_failoverFailures.load();
+	stats->failovers = g_failoverSucceeded.load();
+	stats->exhausted = g_failoverExhausted.load();
+	stats->degraded = g_failoverDegraded.load();
+	return true;
+}
+
+extern "C" SRAL_API void SRAL_ResetFailoverStats(void) {
+	std::lock_guard<std::mutex> lock(g_failoverMutex);
+	g_degradedUntil.clear();
+	g_enginesDegraded.store(SRAL_ENGINE_NONE);
+	g_failoverFailures.store(0);
+	g_failoverSucceeded.store(0);
+	g_failoverExhausted.store(0);
+	g_failoverDegraded.store(0);
+}
+
+extern "C" SRAL_API void SRAL_SetOutputTTL(int ttl_ms) {
+	SRAL_RECORD(Sral::Recorder::CALL_SET_OUTPUT_TTL, 0, false, false, ttl_ms, nullptr);
+	g_outputTtl.store(ttl_ms > 0 ? ttl_ms : 0);
+}
+
+extern "C" SRAL_API void SRAL_SetOutputTag(int tag) {
+	SRAL_RECORD(Sral::Recorder::CALL_SET_OUTPUT_TAG, 0, false, false, tag, nullptr);
+	g_outputTag.store(tag);
+}
+
+// Stops the output last passed to an engine if it matches and the engine is still speaking it.
+template <typename F>
+static bool cancel_in_flight(F&& matches) {
+	InFlightOutput output;
+	{
+		std::lock_guard<std::mutex> lock(g_inFlightMutex);
+		if (g_inFlight.id == 0 || !matches(g_inFlight))return false;
+		output = g_inFlight;
+		g_inFlight = InFlightOutput();
+	}
+	if (!dispatch(output.engine, [](auto* impl) { return impl->IsSpeaking(); }))return false;
+	return dispatch(output.engine, [](auto* impl) { return impl->StopSpeech(); });
+}
+
+extern "C" SRAL_API bool SRAL_Cancel(uint64_t utterance_id) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_CANCEL, 0, false, false, 0, nullptr, &utterance_id);
+	if (utterance_id == 0)return false;
+	bool cancelled;
+	if (utterance_id & Sral::TimerWheel::kIdFlag) {
+		std::lock_guard<std::mutex> lock(g_timersMutex);
+		cancelled = g_timers.Cancel(utterance_id) || cancel_pump_due([utterance_id](const Sral::QueuedOutput& o) { return o.id == utterance_id; }) != 0;
+	}
+	else {
+		{
+			std::lock_guard<std::mutex> lock(g_outputQueueMutex);
+			cancelled = g_outputQueue.Cancel(utterance_id);
+		}
+		if (cancelled) g_outputQueueSpace.notify_all();
+	}
+	if (!cancelled) cancelled = cancel_in_flight([utterance_id](const InFlightOutput& o) { return o.id == utterance_id; });
+	if (cancelled) g_outputsCancelled++;
+	return cancelled;
+}
+
+extern "C" SRAL_API int SRAL_CancelIf(int tag) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_CANCEL_IF, 0, false, false, tag, nullptr);
+	if (tag == 0)return 0;
+	size_t cancelled;
+	{
+		std::lock_guard<std::mutex> lock(g_timersMutex);
+		cancelled = g_timers.CancelIf(tag) + cancel_pump_due([tag](const Sral::QueuedOutput& o) { return o.tag == tag; });
+	}
+	{
+		std::lock_guard<std::mutex> lock(g_outputQueueMutex);
+		cancelled += g_outputQueue.CancelIf(tag);
+	}
+	g_outputQueueSpace.notify_all();
+	if (cancel_in_flight([tag](const InFlightOutput& o) { return o.tag == tag; })) cancelled++;
+	g_outputsCancelled += cancelled;
+	return static_cast<int>(cancelled);
+}
+
+extern "C" SRAL_API bool SRAL_GetQueueStats(SRAL_QueueStats* stats) {
+	if (stats == nullptr)return false;
+	stats->queued = g_outputsQueued.load();
+	stats->replaced = g_outputsReplaced.load();
+	stats->spoken = g_outputsSpoken.load();
+	stats->expired = g_outputsExpired.load();
+	stats->dropped = g_outputsDropped.load();
+	stats->merged = g_outputsMerged.load();
+	stats->cancelled = g_outputsCancelled.load();
+	stats->aggregated = g_outputsAggregated.load();
+	std::lock_guard<std::mutex> lock(g_outputQueueMutex);
+	stats->depth = g_outputQueue.Size();
+	stats->depth_bytes = g_outputQueue.Bytes();
+	return true;
+}
+
+extern "C" SRAL_API bool SRAL_SetQueueLimits(int max_items, int max_bytes, int policy, int timeout_ms) {
+	const int32_t args[] = { max_items, max_bytes, policy, timeout_ms };
+	SRAL_RECORD(Sral::Recorder::CALL_SET_QUEUE_LIMITS, 0, false, false, 0, nullptr, nullptr, args, sizeof(args));
+	if (max_items < 0 || max_bytes < 0 || timeout_ms < 0)return false;
+	if (policy < SRAL_QUEUE_DROP_OLDEST || policy > SRAL_QUEUE_MERGE)return false;
+	{
+		std::lock_guard<std::mutex> lock(g_outputQueueMutex);
+		g_queueLimits.maxItems = static_cast<size_t>(max_items);
+		g_queueLimits.maxBytes = static_cast<size_t>(max_bytes);
+		g_queueLimits.policy = policy;
+		g_queueLimits.timeout = timeout_ms;
+	}
+	// Blocked producers re-check against the new limits.
+	g_outputQueueSpace.notify_all();
+	return true;
+}
+
+extern "C" SRAL_API void SRAL_ResetQueueStats(void) {
+	g_outputsQueued.store(0);
+	g_outputsReplaced.store(0);
+	g_outputsSpoken.store(0);
+	g_outputsExpired.store(0);
+	g_outputsDropped.store(0);
+	g_outputsMerged.store(0);
+	g_outputsCancelled.store(0);
+	g_outputsAggregated.store(0);
+}
+
+extern "C" SRAL_API bool SRAL_SetAggregation(int max_bytes, int timeout_ms, int break_ms) {
+	const int32_t args[] = { max_bytes, timeout_ms, break_ms };
+	SRAL_RECORD(Sral::Recorder::CALL_SET_AGGREGATION, 0, false, false, 0, nullptr, nullptr, args, sizeof(args));
+	if (max_bytes < 0 || timeout_ms < 0 || break_ms < 0)return false;
+	std::lock_guard<std::mutex> lock(g_outputQueueMutex);
+	g_aggregation.maxBytes = static_cast<size_t>(max_bytes);
+	g_aggregation.timeout = timeout_ms;
+	g_aggregation.breakTime = break_ms;
+	return true;
+}
+
+extern "C" SRAL_API void SRAL_SetUtteranceCallback(SRAL_UtteranceCallback callback, void* user_data) {
+	SRAL_RECORD(Sral::Recorder::CALL_SET_UTTERANCE_CALLBACK, 0, false, false, callback != nullptr, nullptr);
+	{
+		std::lock_guard<std::mutex> lock(g_utteranceCallbackMutex);
+		g_utteranceCallback = callback;
+		g_utteranceCallbackData = user_data;
+	}
+	Sral::g_markReached.store(callback ? &mark_reached : nullptr);
+}
+
+extern "C" SRAL_API bool SRAL_SetEnginePriority(const int* order, int count) {
+	SRAL_RECORD(Sral::Recorder::CALL_SET_ENGINE_PRIORITY, 0, false, false, count, nullptr, nullptr, order, count > 0 ? static_cast<uint32_t>(count * sizeof(int)) : 0);
+	if (count > 0 && order == nullptr)return false;
+	std::vector<SRAL_Engines> priority;
+	for (int i = 0; i < count; ++i) {
+		if (order[i] <= 0 || (order[i] & (order[i] - 1)) != 0)return false;
+		priority.push_back(static_cast<SRAL_Engines>(order[i]));
+	}
+	std::lock_guard<std::mutex> lock(g_selectionMutex);
+	g_priority = std::move(priority);
+	g_priorityPinned.store(!g_priority.empty());
+	return true;
+}
+
+extern "C" SRAL_API void SRAL_SetAdaptiveEngineSelection(bool enable) {
+	SRAL_RECORD(Sral::Recorder::CALL_SET_ADAPTIVE_ENGINE_SELECTION, 0, false, false, enable, nullptr);
+	g_adaptiveSelection.store(enable);
+}
+
+extern "C" SRAL_API bool SRAL_GetEngineStats(int engine, SRAL_EngineStats* stats) {
+	if (stats == nullptr)return false;
+	Sral::Engine* e = engine == 0 ? g_currentEngine : get_engine(engine);
+	if (e == nullptr)return false;
+	e->latency.Export(stats);
+	return true;
+}
+
+// Adds a middleware created by make to the engine, or one to each available engine when engine is 0.
+template <typename F>
+static bool add_middleware(int engine, F&& make) {
+	if (engine != 0) {
+		if (g_engines.Get(engine) == nullptr)return false;
+		return g_engines.AddMiddleware(static_cast<SRAL_Engines>(engine), make());
+	}
+	bool added = false;
+	for (const auto& [value, ptr] : g_engines) {
+		added = g_engines.AddMiddleware(value, make()) || added;
+	}
+	return added;
+}
+
+extern "C" SRAL_API bool SRAL_AddTextFilter(int engine, SRAL_TextFilter filter, void* user_data) {
+	SRAL_RECORD(Sral::Recorder::CALL_ADD_TEXT_FILTER, engine, engine != 0, false, 0, nullptr);
+	if (filter == nullptr)return false;
+	return add_middleware(engine, [&] { return std::make_unique<Sral::TextFilter>(filter, user_data); });
+}
+
+extern "C" SRAL_API bool SRAL_AddRateLimit(int engine, int max_per_second, int burst) {
+	SRAL_RECORD(Sral::Recorder::CALL_ADD_RATE_LIMIT, engine, engine != 0, false, max_per_second, nullptr, &burst);
+	if (max_per_second <= 0)return false;
+	return add_middleware(engine, [&] { return std::make_unique<Sral::RateLimiter>(max_per_second, burst); });
+}
+
+extern "C" SRAL_API bool SRAL_AddCoalescer(int engine, int window_ms) {
+	SRAL_RECORD(Sral::Recorder::CALL_ADD_COALESCER, engine, engine != 0, false, window_ms, nullptr);
+	if (window_ms <= 0)return false;
+	return add_middleware(engine, [&] { return std::make_unique<Sral::Coalescer>(window_ms); });
+}
+
+extern "C" SRAL_API void SRAL_ClearMiddleware(int engine) {
+	SRAL_RECORD(Sral::Recorder::CALL_CLEAR_MIDDLEWARE, engine, engine != 0, false, 0, nullptr);
+	if (engine != 0) {
+		if (g_engines.Get(engine) != nullptr) g_engines.ClearMiddleware(static_cast<SRAL_Engines>(engine));
+		return;
+	}
+	for (const auto& [value, ptr] : g_engines) {
+		g_engines.ClearMiddleware(value);
+	}
+}
+
+// Delivers the oldest mark held back for SRAL_Pump. Returns whether there was one.
+static bool pump_mark() {
+	uint64_t id;
+	SRAL_UtteranceCallback callback;
+	void* user_data;
+	{
+		std::lock_guard<std::mutex> lock(g_utteranceCallbackMutex);
+		if (g_pendingMarks.empty())return false;
+		id = g_pendingMarks.front();
+		g_pendingMarks.pop_front();
+		callback = g_utteranceCallback;
+		user_data = g_utteranceCallbackData;
+	}
+	if (callback) callback(id, user_data);
+	return true;
+}
+
+extern "C" SRAL_API int SRAL_Pump(uint64_t max_time_us) {
+	SRAL_TRACE_API();
+	SRAL_RECORD(Sral::Recorder::CALL_PUMP, 0, false, false, 0, nullptr, nullptr, &max_time_us, sizeof(max_time_us));
+	if (!Sral::g_pumpMode.load() || !SRAL_IsInitialized())return 0;
+	const uint64_t begin = Sral::LatencyTracker::Now();
+	for (const auto& [value, ptr] : g_engines) {
+		if (!(g_enginesReady.load() & value)) continue;
+		dispatch(ptr, [begin](auto* impl) { impl->Pump(begin); });
+	}
+	// One item of each kind per pass, so that a backlog of one kind cannot starve the others, until nothing is
+	// left to do or the budget is spent. The budget is checked between items, so a call overruns it by at most one pass.
+	int done = 0;
+	uint64_t now = begin;
+	while (max_time_us == 0 || now - begin < max_time_us) {
+		const int before = done;
+		if (pump_mark()) done++;
+		if (pump_timer(now)) done++;
+		if (pump_output(now)) done++;
+		if (done == before)break;
+		now = Sral::LatencyTracker::Now();
+	}
+	return done;
+}
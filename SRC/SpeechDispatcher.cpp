@@ -1,14 +1,98 @@
 // Actually, it should only be SpeechDispatcher, but since we currently don't support anything else on Linux, we'll integrate BRLTTY here.
 #include "../Dep/utf-8.h"
 #include "SpeechDispatcher.h"
-#include <brlapi.h>
 #include "Encoding.h"
+#include "Trace.h"
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cmath>
+#include <dlfcn.h>
+#include <initializer_list>
 #include <locale.h>
+#include <poll.h>
 
 std::atomic<bool> g_isSpeaking{false};
+// The notification callback has no user data, so it reaches the tracker of the (only) instance through here.
+static std::atomic<Sral::LatencyTracker*> g_latency{nullptr};
+
+// How often a live connection is checked, and the reconnect backoff range while the daemon is gone.
+static constexpr std::chrono::milliseconds kHealthCheckInterval{500};
+static constexpr std::chrono::milliseconds kMinReconnectDelay{100};
+static constexpr std::chrono::milliseconds kMaxReconnectDelay{10000};
+
+static void* open_library(std::initializer_list<const char*> names) {
+	for (const char* name : names) {
+		void* lib = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+		if (lib) return lib;
+	}
+	return nullptr;
+}
+
+template <typename T>
+static bool load_symbol(void* lib, const char* name, T& function) {
+	function = reinterpret_cast<T>(dlsym(lib, name));
+	return function != nullptr;
+}
 
 namespace Sral {
+	bool SpeechDispatcher::LoadSpeechd() {
+		if (speechdLib) return true;
+		speechdLib = open_library({ "libspeechd.so.2", "libspeechd.so" });
+		if (speechdLib == nullptr) return false;
+		const bool loaded = load_symbol(speechdLib, "spd_get_default_address", spd_get_default_address) &&
+			load_symbol(speechdLib, "spd_open2", spd_open2) &&
+			load_symbol(speechdLib, "spd_close", spd_close) &&
+			load_symbol(speechdLib, "spd_say", spd_say) &&
+			load_symbol(speechdLib, "spd_char", spd_char) &&
+			load_symbol(speechdLib, "spd_stop", spd_stop) &&
+			load_symbol(speechdLib, "spd_cancel", spd_cancel) &&
+			load_symbol(speechdLib, "spd_pause", spd_pause) &&
+			load_symbol(speechdLib, "spd_resume", spd_resume) &&
+			load_symbol(speechdLib, "spd_set_data_mode", spd_set_data_mode) &&
+			load_symbol(speechdLib, "spd_set_notification_on", spd_set_notification_on) &&
+			load_symbol(speechdLib, "spd_set_punctuation", spd_set_punctuation) &&
+			load_symbol(speechdLib, "spd_set_voice_rate", spd_set_voice_rate) &&
+			load_symbol(speechdLib, "spd_get_voice_rate", spd_get_voice_rate) &&
+			load_symbol(speechdLib, "spd_set_volume", spd_set_volume) &&
+			load_symbol(speechdLib, "spd_get_volume", spd_get_volume) &&
+			load_symbol(speechdLib, "spd_set_synthesis_voice", spd_set_synthesis_voice) &&
+			load_symbol(speechdLib, "spd_list_synthesis_voices", spd_list_synthesis_voices) &&
+			load_symbol(speechdLib, "free_spd_voices", free_spd_voices);
+		if (!loaded) {
+			dlclose(speechdLib);
+			speechdLib = nullptr;
+		}
+		return loaded;
+	}
+
+	bool SpeechDispatcher::LoadBrlapi() {
+		if (brlapiLib) return true;
+		brlapiLib = open_library({ "libbrlapi.so.0.8", "libbrlapi.so.0.7", "libbrlapi.so.0.6", "libbrlapi.so" });
+		if (brlapiLib == nullptr) return false;
+		const bool loaded = load_symbol(brlapiLib, "brlapi_openConnection", brlapi_openConnection) &&
+			load_symbol(brlapiLib, "brlapi_closeConnection", brlapi_closeConnection) &&
+			load_symbol(brlapiLib, "brlapi_enterTtyMode", brlapi_enterTtyMode) &&
+			load_symbol(brlapiLib, "brlapi_leaveTtyMode", brlapi_leaveTtyMode) &&
+			load_symbol(brlapiLib, "brlapi_writeText", brlapi_writeText);
+		if (!loaded) {
+			dlclose(brlapiLib);
+			brlapiLib = nullptr;
+		}
+		return loaded;
+	}
+
+	void SpeechDispatcher::UnloadLibraries() {
+		if (speechdLib) {
+			dlclose(speechdLib);
+			speechdLib = nullptr;
+		}
+		if (brlapiLib) {
+			dlclose(brlapiLib);
+			brlapiLib = nullptr;
+		}
+	}
+
 
 	// Tell me! How do I get a current voice in SPD?
 	// I couldn't find anything better than choosing the first available voice based on locale.
@@ -37,62 +121,198 @@ namespace Sral {
 		return 0;
 	}
 
-	bool SpeechDispatcher::Initialize() {
-		const auto* address = spd_get_default_address(nullptr);
-		if (address == nullptr) {
+	bool SpeechDispatcher::Connect() {
+		SPDConnection* connection = spd_open2("SRAL", nullptr, nullptr, SPD_MODE_THREADED, m_address, true, nullptr);
+		if (connection == nullptr) {
 			return false;
 		}
-		speech = spd_open2("SRAL", nullptr, nullptr, SPD_MODE_THREADED, address, true, nullptr);
-		if (speech == nullptr) {
-			return false;
+
+		spd_set_data_mode(connection, SPD_DATA_SSML);
+
+		connection->callback_begin = &SpeechDispatcher::SpeechNotificationCallback;
+		connection->callback_end = &SpeechDispatcher::SpeechNotificationCallback;
+		connection->callback_cancel = &SpeechDispatcher::SpeechNotificationCallback;
+		connection->callback_im = &SpeechDispatcher::IndexMarkCallback;
+		spd_set_notification_on(connection, SPD_BEGIN);
+		spd_set_notification_on(connection, SPD_END);
+		spd_set_notification_on(connection, SPD_CANCEL);
+		spd_set_notification_on(connection, SPD_INDEX_MARKS);
+
+		{
+			std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
+			speech = connection;
+			m_connected.store(true);
+		}
+		PublishActive(true);
+		return true;
+	}
+
+	void SpeechDispatcher::Disconnect() {
+		SPDConnection* connection;
+		{
+			std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
+			connection = speech;
+			speech = nullptr;
+			m_connected.store(false);
+			ClearVoiceList();
+		}
+		PublishActive(false);
+		g_isSpeaking.store(false);
+		if (connection) spd_close(connection);
+	}
+
+	bool SpeechDispatcher::IsConnectionBroken() {
+		std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
+		if (speech == nullptr) return false;
+		// The library's event thread owns the reads, so only ask for hangup and error conditions.
+		pollfd fd{ speech->socket, 0, 0 };
+		return poll(&fd, 1, 0) > 0 && (fd.revents & (POLLHUP | POLLERR | POLLNVAL)) != 0;
+	}
+
+	void SpeechDispatcher::RestoreSettings() {
+		std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
+		if (speech == nullptr) return;
+		if (m_rate) spd_set_voice_rate(speech, *m_rate);
+		if (m_volume) spd_set_volume(speech, *m_volume);
+		if (m_punctuation) spd_set_punctuation(speech, static_cast<SPDPunctuation>(*m_punctuation));
+		if (m_voiceName.empty()) return;
+		spd_set_synthesis_voice(speech, m_voiceName.c_str());
+		// The restarted daemon may list its voices in a different order.
+		RefreshVoiceList();
+		for (int i = 0; i < m_voiceCount; ++i) {
+			if (m_voiceList[i]->name && m_voiceName == m_voiceList[i]->name) {
+				m_voiceIndex = i;
+				break;
+			}
+		}
+	}
+
+	void SpeechDispatcher::RequestHealthCheck() {
+		{
+			std::lock_guard<std::mutex> lock(m_monitorMutex);
+			m_checkNow = true;
+		}
+		m_monitorCv.notify_one();
+	}
+
+	// Drops a broken connection and tries to reconnect, backing off while the daemon stays away.
+	void SpeechDispatcher::CheckHealth() {
+		if (GetActive() && IsConnectionBroken()) {
+			SRAL_TRACE_INSTANT("spd", "disconnected", 0);
+			Disconnect();
+			m_reconnectDelay = kMinReconnectDelay;
+		}
+		if (!GetActive()) {
+			if (Connect()) {
+				SRAL_TRACE_INSTANT("spd", "reconnected", 0);
+				RestoreSettings();
+				// The restarted daemon starts from its defaults for whatever the user never set.
+				shadow.Invalidate();
+				m_reconnectDelay = kMinReconnectDelay;
+			}
+			else {
+				m_reconnectDelay = std::min(m_reconnectDelay * 2, kMaxReconnectDelay);
+			}
 		}
+	}
+
+	std::chrono::milliseconds SpeechDispatcher::NextCheckDelay() {
+		return GetActive() ? kHealthCheckInterval : m_reconnectDelay;
+	}
 
-		spd_set_data_mode(speech, SPD_DATA_SSML);
+	void SpeechDispatcher::MonitorThread() {
+		std::unique_lock<std::mutex> lock(m_monitorMutex);
+		while (!m_stopMonitor) {
+			m_monitorCv.wait_for(lock, NextCheckDelay(), [this] { return m_stopMonitor || m_checkNow; });
+			if (m_stopMonitor) break;
+			m_checkNow = false;
+			lock.unlock();
+			CheckHealth();
+			lock.lock();
+		}
+	}
 
-		speech->callback_begin = &SpeechDispatcher::SpeechNotificationCallback;
-		speech->callback_end = &SpeechDispatcher::SpeechNotificationCallback;
-		speech->callback_cancel = &SpeechDispatcher::SpeechNotificationCallback;
-		spd_set_notification_on(speech, SPD_BEGIN);
-		spd_set_notification_on(speech, SPD_END);
-		spd_set_notification_on(speech, SPD_CANCEL);
+	void SpeechDispatcher::Pump(uint64_t now) {
+		// Without the monitor thread, the connection is checked here on the same schedule.
+		if (speechdLib == nullptr) return;
+		{
+			std::lock_guard<std::mutex> lock(m_monitorMutex);
+			if (!m_checkNow && now < m_nextCheck) return;
+			m_checkNow = false;
+		}
+		CheckHealth();
+		m_nextCheck = now + std::chrono::duration_cast<std::chrono::microseconds>(NextCheckDelay()).count();
+	}
+
+	bool SpeechDispatcher::Initialize() {
+		if (!LoadSpeechd()) {
+			return false;
+		}
+		m_address = spd_get_default_address(nullptr);
+		if (m_address == nullptr || !Connect()) {
+			UnloadLibraries();
+			return false;
+		}
+		g_latency.store(&latency);
 
 		int index = this->SetVoiceIndex();
 		this->SetParameter(SRAL_PARAM_VOICE_INDEX, &index);
-		brailleInitialized = brlapi_openConnection(nullptr, nullptr) < 0 ? false : true;
-		brlapi_enterTtyMode(BRLAPI_TTY_DEFAULT, nullptr);
+		brailleInitialized = LoadBrlapi() && brlapi_openConnection(nullptr, nullptr) >= 0;
+		if (brailleInitialized) brlapi_enterTtyMode(BRLAPI_TTY_DEFAULT, nullptr);
+
+		m_stopMonitor = false;
+		m_checkNow = false;
+		m_reconnectDelay = kMinReconnectDelay;
+		m_nextCheck = LatencyTracker::Now() + std::chrono::duration_cast<std::chrono::microseconds>(kHealthCheckInterval).count();
+		if (!g_pumpMode.load()) m_monitor = std::thread(&SpeechDispatcher::MonitorThread, this);
 		return true;
 	}
 
 	bool SpeechDispatcher::GetActive() {
-		return speech != nullptr;
+		return m_connected.load();
 	}
 
 	bool SpeechDispatcher::Uninitialize() {
-		if (speech == nullptr)return false;
-		g_isSpeaking.store(false);
-		ReleaseAllStrings();
-		ClearVoiceList();
+		// The connection may be down while the monitor is waiting to reconnect, so go by the library instead.
+		if (speechdLib == nullptr)return false;
+		{
+			std::lock_guard<std::mutex> lock(m_monitorMutex);
+			m_stopMonitor = true;
+		}
+		m_monitorCv.notify_one();
+		if (m_monitor.joinable()) m_monitor.join();
+
+		g_latency.store(nullptr);
+		m_strings.Clear();
+		Disconnect();
 		m_voiceIndex = 0;
-		spd_close(speech);
-		speech = nullptr;
+		m_rate.reset();
+		m_volume.reset();
+		m_punctuation.reset();
+		m_voiceName.clear();
+		m_address = nullptr;
 
 		if (brailleInitialized) {
 			brlapi_leaveTtyMode();
 			brlapi_closeConnection();
 			brailleInitialized = false;
 		}
+		UnloadLibraries();
 		return true;
 	}
 
 	bool SpeechDispatcher::Speak(const char* text, bool interrupt) {
 		if (!enableSpelling) {
-			std::string text_str(text);
-			if (text_str.empty()) return false;
-			XmlEncode(text_str);
-			std::string final = "<speak>" + text_str + "</speak>";
-			return this->SpeakSsml(text_str.c_str(), interrupt);
+			if (*text == '\0') return false;
+			// Encoded into a buffer kept by the thread, so that speaking allocates nothing once it has grown.
+			thread_local std::string encoded;
+			encoded.clear();
+			XmlEncode(text, encoded);
+			return this->SpeakSsml(encoded.c_str(), interrupt);
 		}
 		else {
+			std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
+			if (speech == nullptr)return false;
 			if (interrupt) {
 				spd_stop(speech);
 				spd_cancel(speech);
@@ -102,14 +322,64 @@ namespace Sral {
 			bool result = true;
 			utf8_init(&iter, text);
 			while (utf8_next(&iter) && result) {
-				result = (spd_char(speech, SPD_IMPORTANT, utf8_getchar(&iter)) != -1);
+				const uint64_t submitted = LatencyTracker::Now();
+				SRAL_TRACE_SCOPE("spd", "spd_char", 0);
+				const int id = spd_char(speech, SPD_IMPORTANT, utf8_getchar(&iter));
+				result = id != -1;
+				if (result) latency.Submitted(id, submitted);
 			}
 			return result;
 		}
 		return false;
 	}
 
+	// The overrides go into the message as SSML, so it is a single spd_say and the connection's settings are left alone.
+	// Rate and volume become changes relative to what the connection is set to. The -100 to 100 rate scale runs from
+	// half to twice the normal speed, so the difference becomes a percentage of the current speed, and the -100 to 100
+	// volume scale is half a point of the SSML 0 to 100 volume scale per step.
+	bool SpeechDispatcher::SpeakWithParams(const char* text, bool interrupt, const SRAL_UtteranceParams& params) {
+		// Spelled text is sent a character at a time, which markup cannot wrap.
+		if (enableSpelling) return Engine::SpeakWithParams(text, interrupt, params);
+		std::string body = text;
+		if (body.empty()) return false;
+		XmlEncode(body);
+		std::string ssml = "<speak>";
+		std::string close = "</speak>";
+		// The voice list and the current rate and volume are changed under the lock by SetParameter and reconnects.
+		std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
+		if (speech == nullptr)return false;
+		if (params.flags & SRAL_UTTERANCE_VOICE) {
+			if (m_voiceList == nullptr) RefreshVoiceList();
+			if (params.voice_index >= 0 && params.voice_index < m_voiceCount && m_voiceList[params.voice_index]->name) {
+				std::string name = m_voiceList[params.voice_index]->name;
+				XmlEncode(name);
+				ssml += "<voice name=\"" + name + "\">";
+				close.insert(0, "</voice>");
+			}
+		}
+		std::string prosody;
+		if (params.flags & SRAL_UTTERANCE_RATE) {
+			// Nothing may have set the rate through this connection, in which case the daemon's default applies.
+			const int current = m_rate ? *m_rate : spd_get_voice_rate(speech);
+			const int change = static_cast<int>(std::lround((std::exp2((params.rate - current) / 100.0) - 1.0) * 100.0));
+			prosody += " rate=\"" + std::string(change >= 0 ? "+" : "") + std::to_string(change) + "%\"";
+		}
+		if (params.flags & SRAL_UTTERANCE_VOLUME) {
+			const int current = m_volume ? *m_volume : spd_get_volume(speech);
+			const int change = (params.volume - current) / 2;
+			prosody += " volume=\"" + std::string(change >= 0 ? "+" : "") + std::to_string(change) + "\"";
+		}
+		if (!prosody.empty()) {
+			ssml += "<prosody" + prosody + ">";
+			close.insert(0, "</prosody>");
+		}
+		ssml += body;
+		ssml += close;
+		return SpeakSsml(ssml.c_str(), interrupt);
+	}
+
 	bool SpeechDispatcher::SpeakSsml(const char* ssml, bool interrupt) {
+		std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
 		if (speech == nullptr)return false;
 		if (interrupt) {
 			spd_stop(speech);
@@ -121,7 +391,18 @@ namespace Sral {
 
 		}
 
-		return spd_say(speech, SPD_IMPORTANT, ssml) != -1;
+		const uint64_t submitted = LatencyTracker::Now();
+		int id;
+		{
+			SRAL_TRACE_SCOPE("spd", "spd_say", 0);
+			id = spd_say(speech, SPD_IMPORTANT, ssml);
+		}
+		if (id == -1) {
+			RequestHealthCheck();
+			return false;
+		}
+		latency.Submitted(id, submitted);
+		return true;
 	}
 
 	bool SpeechDispatcher::Braille(const char* text) {
@@ -134,26 +415,32 @@ namespace Sral {
 	}
 
 	bool SpeechDispatcher::SetParameter(int param, const void* value) {
+		std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
 		if (speech == nullptr)return false;
 		switch (param) {
 		case SRAL_PARAM_SYMBOL_LEVEL:
-			spd_set_punctuation(speech, static_cast<SPDPunctuation>(*reinterpret_cast<const int*>(value)));
+			m_punctuation = *reinterpret_cast<const int*>(value);
+			spd_set_punctuation(speech, static_cast<SPDPunctuation>(*m_punctuation));
 			break;
 		case SRAL_PARAM_SPEECH_RATE:
-			spd_set_voice_rate(speech, *reinterpret_cast<const int*>(value));
+			m_rate = *reinterpret_cast<const int*>(value);
+			spd_set_voice_rate(speech, *m_rate);
 			break;
 		case SRAL_PARAM_SPEECH_VOLUME:
-			spd_set_volume(speech, *reinterpret_cast<const int*>(value));
+			m_volume = *reinterpret_cast<const int*>(value);
+			spd_set_volume(speech, *m_volume);
 			break;
 		case SRAL_PARAM_ENABLE_SPELLING:
 			this->enableSpelling = *reinterpret_cast<const bool*>(value);
 			break;
 		case SRAL_PARAM_VOICE_INDEX: {
-			RefreshVoiceList();
-			if (!m_voiceList) return false;
 			int index = *reinterpret_cast<const int*>(value);
+			// The list is dropped when the connection is, so it is only fetched again for an index it does not have.
+			if (!m_voiceList || index < 0 || index >= m_voiceCount) RefreshVoiceList();
+			if (!m_voiceList || index < 0 || index >= m_voiceCount) return false;
 			if (spd_set_synthesis_voice(speech, m_voiceList[index]->name) == 0) {
 				m_voiceIndex = index;
+				m_voiceName = m_voiceList[index]->name;
 				return true;
 			}
 			break;
@@ -165,7 +452,15 @@ namespace Sral {
 		return true;
 	}
 
+	void SpeechDispatcher::SetParameters(const SRAL_ParamValue* values, size_t count, bool* results) {
+		// Speaking takes the same lock, so no message goes out with only part of a profile applied,
+		// and a reconnect cannot come between the values.
+		std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
+		Engine::SetParameters(values, count, results);
+	}
+
 	bool SpeechDispatcher::GetParameter(int param, void* value) {
+		std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
 		if (speech == nullptr)return false;
 		switch (param) {
 		case SRAL_PARAM_SPEECH_RATE:
@@ -178,16 +473,15 @@ namespace Sral {
 			*(bool*)value = this->enableSpelling;
 			return true;
 		case SRAL_PARAM_VOICE_PROPERTIES: {
-			ReleaseAllStrings();
 			SRAL_VoiceInfo* voiceProperties = (SRAL_VoiceInfo*)value;
 			int index = 0;
 			RefreshVoiceList();
 			for (index; voiceProperties && m_voiceList && index < m_voiceCount; ++index) {
 				voiceProperties[index].index = index;
-				voiceProperties[index].name = AddString(m_voiceList[index]->name);
-				voiceProperties[index].language = AddString(m_voiceList[index]->language);
-				voiceProperties[index].gender = AddString(m_voiceList[index]->variant);
-				voiceProperties[index].vendor = AddString("Unknown");
+				voiceProperties[index].name = m_strings.Intern(m_voiceList[index]->name);
+				voiceProperties[index].language = m_strings.Intern(m_voiceList[index]->language);
+				voiceProperties[index].gender = m_strings.Intern(m_voiceList[index]->variant);
+				voiceProperties[index].vendor = m_strings.Intern("Unknown");
 			}
 
 			return true;
@@ -209,6 +503,7 @@ namespace Sral {
 	}
 
 	bool SpeechDispatcher::StopSpeech() {
+		std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
 		if (speech == nullptr)return false;
 		spd_stop(speech);
 		spd_cancel(speech);
@@ -216,29 +511,50 @@ namespace Sral {
 	}
 
 	bool SpeechDispatcher::PauseSpeech() {
+		std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
 		if (!GetActive())return false;
 		this->paused = true;
 		return spd_pause(speech) == 0;
 	}
 
 	bool SpeechDispatcher::ResumeSpeech() {
+		std::lock_guard<std::recursive_mutex> lock(m_connectionMutex);
 		if (!GetActive())return false;
 		this->paused = false;
 		return spd_resume(speech) == 0;
 	}
 
 	void SpeechDispatcher::SpeechNotificationCallback(size_t msg_id, size_t client_id, SPDNotificationType type) {
+		(void)client_id;
+		LatencyTracker* tracker = g_latency.load();
 		switch (type) {
 			case SPD_EVENT_BEGIN:
+				SRAL_TRACE_INSTANT("spd", "SPD_EVENT_BEGIN", msg_id);
 				g_isSpeaking.store(true);
+				if (tracker) tracker->Began(msg_id);
 				break;
 			case SPD_EVENT_END:
+				SRAL_TRACE_INSTANT("spd", "SPD_EVENT_END", msg_id);
+				g_isSpeaking.store(false);
+				if (tracker) tracker->Ended(msg_id);
+				break;
 			case SPD_EVENT_CANCEL:
+				SRAL_TRACE_INSTANT("spd", "SPD_EVENT_CANCEL", msg_id);
 				g_isSpeaking.store(false);
+				if (tracker) tracker->Cancelled(msg_id);
 				break;
 			default:
 				return;
 		}
 	}
+
+	void SpeechDispatcher::IndexMarkCallback(size_t msg_id, size_t client_id, SPDNotificationType type, char* index_mark) {
+		(void)msg_id;
+		(void)client_id;
+		if (type != SPD_EVENT_INDEX_MARK) return;
+		SRAL_TRACE_INSTANT("spd", "SPD_EVENT_INDEX_MARK", msg_id);
+		auto listener = g_markReached.load();
+		if (listener) listener(index_mark);
+	}
 }
 
@@ -2,13 +2,24 @@
 #define SPEECHDISPATCHER_H_
 #include "../Include/SRAL.h"
 #include "Engine.h"
+// Only for the types: both libraries are loaded with dlopen in Initialize, so that SRAL still loads
+// on systems where they are not installed.
 #include <speech-dispatcher/libspeechd.h>
+#include <brlapi.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
 
 namespace Sral {
 	class SpeechDispatcher final : public Engine {
 	public:
 		bool Speak(const char* text, bool interrupt)override;
 		bool SpeakSsml(const char* ssml, bool interrupt)override;
+		bool SpeakWithParams(const char* text, bool interrupt, const SRAL_UtteranceParams& params)override;
 
 		bool Braille(const char* text)override;
 
@@ -16,6 +27,7 @@ namespace Sral {
 
 		bool SetParameter(int param, const void* value)override;
 		bool GetParameter(int param, void* value) override;
+		void SetParameters(const SRAL_ParamValue* values, size_t count, bool* results)override;
 
 
 		bool StopSpeech()override;
@@ -27,6 +39,7 @@ namespace Sral {
 		bool GetActive()override;
 		bool Initialize()override;
 		bool Uninitialize()override;
+		void Pump(uint64_t now)override;
 		int GetFeatures()override {
 			return SRAL_SUPPORTS_SPEECH | SRAL_SUPPORTS_BRAILLE | SRAL_SUPPORTS_SPEECH_RATE | SRAL_SUPPORTS_SPEECH_VOLUME | SRAL_SUPPORTS_PAUSE_SPEECH | SRAL_SUPPORTS_SPELLING | SRAL_SUPPORTS_SSML | SRAL_SUPPORTS_SELECT_VOICE;
 		}
@@ -36,7 +49,69 @@ namespace Sral {
 		}
 
 	private:
+		void* speechdLib = nullptr;
+		void* brlapiLib = nullptr;
+		bool LoadSpeechd();
+		bool LoadBrlapi();
+		void UnloadLibraries();
+
+		// These shadow the library functions of the same name, so calls read as if they were linked directly.
+		decltype(&::spd_get_default_address) spd_get_default_address = nullptr;
+		decltype(&::spd_open2) spd_open2 = nullptr;
+		decltype(&::spd_close) spd_close = nullptr;
+		decltype(&::spd_say) spd_say = nullptr;
+		decltype(&::spd_char) spd_char = nullptr;
+		decltype(&::spd_stop) spd_stop = nullptr;
+		decltype(&::spd_cancel) spd_cancel = nullptr;
+		decltype(&::spd_pause) spd_pause = nullptr;
+		decltype(&::spd_resume) spd_resume = nullptr;
+		decltype(&::spd_set_data_mode) spd_set_data_mode = nullptr;
+		decltype(&::spd_set_notification_on) spd_set_notification_on = nullptr;
+		decltype(&::spd_set_punctuation) spd_set_punctuation = nullptr;
+		decltype(&::spd_set_voice_rate) spd_set_voice_rate = nullptr;
+		decltype(&::spd_get_voice_rate) spd_get_voice_rate = nullptr;
+		decltype(&::spd_set_volume) spd_set_volume = nullptr;
+		decltype(&::spd_get_volume) spd_get_volume = nullptr;
+		decltype(&::spd_set_synthesis_voice) spd_set_synthesis_voice = nullptr;
+		decltype(&::spd_list_synthesis_voices) spd_list_synthesis_voices = nullptr;
+		decltype(&::free_spd_voices) free_spd_voices = nullptr;
+
+		decltype(&::brlapi_openConnection) brlapi_openConnection = nullptr;
+		decltype(&::brlapi_closeConnection) brlapi_closeConnection = nullptr;
+		decltype(&::brlapi_enterTtyMode) brlapi_enterTtyMode = nullptr;
+		decltype(&::brlapi_leaveTtyMode) brlapi_leaveTtyMode = nullptr;
+		decltype(&::brlapi_writeText) brlapi_writeText = nullptr;
+
+		// Guards every use of speech: the monitor thread replaces it when the daemon goes away and comes back.
+		std::recursive_mutex m_connectionMutex;
 		SPDConnection* speech = nullptr;
+		// Mirrors speech != nullptr, so that GetActive() does not have to take the lock.
+		std::atomic<bool> m_connected{false};
+		const SPDConnectionAddress* m_address{nullptr};
+		bool Connect();
+		void Disconnect();
+		bool IsConnectionBroken();
+
+		std::thread m_monitor;
+		std::mutex m_monitorMutex;
+		std::condition_variable m_monitorCv;
+		bool m_stopMonitor{false};
+		bool m_checkNow{false};
+		// The reconnect backoff, and in pump mode the LatencyTracker::Now() at which Pump checks the connection next.
+		std::chrono::milliseconds m_reconnectDelay{0};
+		uint64_t m_nextCheck{0};
+		void MonitorThread();
+		void CheckHealth();
+		std::chrono::milliseconds NextCheckDelay();
+		void RequestHealthCheck();
+
+		// What the user has set, reapplied to a new connection after a reconnect.
+		std::optional<int> m_rate;
+		std::optional<int> m_volume;
+		std::optional<int> m_punctuation;
+		std::string m_voiceName;
+		void RestoreSettings();
+
 		bool enableSpelling = false;
 		bool brailleInitialized = false;
 
@@ -61,6 +136,7 @@ namespace Sral {
 		}
 
 		static void SpeechNotificationCallback(size_t msg_id, size_t client_id, SPDNotificationType type);
+		static void IndexMarkCallback(size_t msg_id, size_t client_id, SPDNotificationType type, char* index_mark);
 	};
 }
 #endif
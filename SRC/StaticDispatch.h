@@ -0,0 +1,56 @@
+#ifndef STATICDISPATCH_H_
+#define STATICDISPATCH_H_
+#pragma once
+#include "Engine.h"
+#include <tuple>
+#include <type_traits>
+
+namespace Sral {
+
+	// The engine classes built into this platform, known at compile time.
+	// Visit() hands a call the engine as its final class when it is one of the registered built-in
+	// instances, so the compiler binds the call directly instead of going through the vtable.
+	// Engines installed at runtime, and every engine of an empty set, are called through Engine.
+	template <typename... Engines>
+	class EngineSet {
+	public:
+		template <typename E>
+		void Register(E* engine) {
+			if constexpr ((std::is_same_v<E, Engines> || ...)) {
+				std::get<E*>(m_engines) = engine;
+			}
+		}
+
+		void Forget(Engine* engine) {
+			[[maybe_unused]] auto forget = [engine](auto*& slot) {
+				if (slot == engine) slot = nullptr;
+			};
+			(forget(std::get<Engines*>(m_engines)), ...);
+		}
+
+		void Clear() {
+			m_engines = {};
+		}
+
+		template <typename F>
+		decltype(auto) Visit(Engine* engine, F&& f) const {
+			return VisitFrom<0>(engine, f);
+		}
+
+	private:
+		template <size_t I, typename F>
+		decltype(auto) VisitFrom(Engine* engine, F& f) const {
+			if constexpr (I == sizeof...(Engines)) {
+				return f(engine);
+			}
+			else {
+				auto* candidate = std::get<I>(m_engines);
+				if (engine == candidate) return f(candidate);
+				return VisitFrom<I + 1>(engine, f);
+			}
+		}
+
+		std::tuple<Engines*...> m_engines{};
+	};
+}
+#endif
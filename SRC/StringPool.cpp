@@ -0,0 +1,46 @@
+#include "StringPool.h"
+#include <string.h>
+
+namespace Sral {
+	char* StringPool::Allocate(size_t size) {
+		// Long strings get a block of their own, so that the rest of the current block is not wasted.
+		const bool own = size > kBlockSize / 4;
+		const size_t blockSize = own ? size : kBlockSize;
+		if (own || m_left < size) {
+			m_blocks.reserve(m_blocks.size() + 1);
+			char* block = static_cast<char*>(Allocations::Allocate(blockSize));
+			if (block == nullptr) throw std::bad_alloc();
+			m_blocks.push_back(block);
+			m_bytes += blockSize;
+			if (own) return block;
+			m_next = block;
+			m_left = kBlockSize;
+		}
+		char* p = m_next;
+		m_next += size;
+		m_left -= size;
+		return p;
+	}
+
+	const char* StringPool::Intern(const char* str) {
+		if (str == nullptr) return nullptr;
+		const std::string_view view(str);
+		auto it = m_index.find(view);
+		if (it != m_index.end()) return it->data();
+		char* copy = Allocate(view.size() + 1);
+		memcpy(copy, str, view.size() + 1);
+		m_index.emplace(copy, view.size());
+		return copy;
+	}
+
+	void StringPool::Clear() {
+		m_index.clear();
+		for (char* block : m_blocks) {
+			Allocations::Free(block);
+		}
+		m_blocks.clear();
+		m_next = nullptr;
+		m_left = 0;
+		m_bytes = 0;
+	}
+}
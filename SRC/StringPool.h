@@ -0,0 +1,53 @@
+#ifndef STRINGPOOL_H_
+#define STRINGPOOL_H_
+#pragma once
+#include "Allocations.h"
+#include <stddef.h>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace Sral {
+
+	// Interned strings handed out to callers, such as the names in SRAL_VoiceInfo.
+	// Strings are copied into large blocks instead of being allocated one by one, and equal strings share a
+	// single copy, so listing the same voices again adds nothing. The copies stay where they are until Clear(),
+	// which engines only call when they are uninitialized.
+	// Not thread safe; engines call it under whatever lock guards their voice list.
+	class StringPool {
+	public:
+		static constexpr size_t kBlockSize = 4096;
+
+		StringPool() = default;
+		~StringPool() {
+			Clear();
+		}
+		StringPool(const StringPool&) = delete;
+		StringPool& operator=(const StringPool&) = delete;
+
+		// Returns the pool's copy of str, adding it if there is none yet, or nullptr if str is nullptr.
+		const char* Intern(const char* str);
+
+		void Clear();
+		// The number of distinct strings in the pool.
+		size_t Size() const {
+			return m_index.size();
+		}
+		// The total size of the blocks the strings are kept in.
+		size_t Bytes() const {
+			return m_bytes;
+		}
+
+	private:
+		char* Allocate(size_t size);
+
+		// From Allocations, like the memory SRAL hands out.
+		std::vector<char*, Allocations::Allocator<char*>> m_blocks;
+		char* m_next{nullptr}; // Free space in the newest regular block.
+		size_t m_left{0};
+		size_t m_bytes{0};
+		std::unordered_set<std::string_view, std::hash<std::string_view>, std::equal_to<std::string_view>, Allocations::Allocator<std::string_view>> m_index;
+	};
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include "TimerWheel.h"
+#include <algorithm>
+#include <bit>
+
+namespace Sral {
+	TimerWheel::TimerWheel(uint64_t now) : m_current(now / kTickUs) {
+		for (auto& level : m_slots) {
+			level.fill(kNone);
+		}
+	}
+
+	uint64_t TimerWheel::Add(uint64_t now, uint64_t due, QueuedOutput&& output) {
+		// An empty wheel is not advanced, so catch up before placing the timer relative to the current tick.
+		if (m_size == 0) m_current = std::max(m_current, now / kTickUs);
+		uint32_t index;
+		if (m_free != kNone) {
+			index = m_free;
+			m_free = m_entries[index].next;
+		}
+		else {
+			m_entries.emplace_back();
+			index = static_cast<uint32_t>(m_entries.size() - 1);
+		}
+		Entry& entry = m_entries[index];
+		entry.output = std::move(output);
+		entry.tick = (due + kTickUs - 1) / kTickUs;
+		entry.generation = (entry.generation + 1) & 0x7fffffff;
+		entry.used = true;
+		entry.output.id = kIdFlag | (static_cast<uint64_t>(entry.generation) << 32) | index;
+		Link(index);
+		m_size++;
+		return entry.output.id;
+	}
+
+	void TimerWheel::Unlink(uint32_t index) {
+		Entry& entry = m_entries[index];
+		if (entry.prev != kNone) m_entries[entry.prev].next = entry.next;
+		else {
+			m_slots[entry.level][entry.slot] = entry.next;
+			if (entry.next == kNone) m_occupied[entry.level] &= ~(uint64_t(1) << entry.slot);
+		}
+		if (entry.next != kNone) m_entries[entry.next].prev = entry.prev;
+	}
+
+	// Puts an unlinked entry on the free list.
+	void TimerWheel::Release(uint32_t index) {
+		Entry& entry = m_entries[index];
+		entry.output = QueuedOutput();
+		entry.used = false;
+		entry.prev = kNone;
+		entry.next = m_free;
+		m_free = index;
+		m_size--;
+	}
+
+	bool TimerWheel::Cancel(uint64_t id) {
+		const uint32_t index = static_cast<uint32_t>(id);
+		if (!(id & kIdFlag) || index >= m_entries.size()) return false;
+		const Entry& entry = m_entries[index];
+		if (!entry.used || entry.generation != static_cast<uint32_t>((id & ~kIdFlag) >> 32)) return false;
+		Unlink(index);
+		Release(index);
+		return true;
+	}
+
+	size_t TimerWheel::CancelIf(int tag) {
+		size_t cancelled = 0;
+		for (uint32_t index = 0; index < m_entries.size(); ++index) {
+			if (m_entries[index].used && m_entries[index].output.tag == tag) {
+				Unlink(index);
+				Release(index);
+				cancelled++;
+			}
+		}
+		return cancelled;
+	}
+
+	void TimerWheel::Link(uint32_t index) {
+		Entry& entry = m_entries[index];
+		uint64_t tick = std::max(entry.tick, m_current);
+		const uint64_t delta = tick - m_current;
+		int level = 0;
+		while (level < kLevels - 1 && delta >= (uint64_t(1) << (kSlotBits * (level + 1)))) level++;
+		// Timers beyond the range of the wheel wait in the last slot it reaches and are placed again from there.
+		const uint64_t range = uint64_t(1) << (kSlotBits * kLevels);
+		if (delta >= range) tick = m_current + range - 1;
+		const int slot = static_cast<int>((tick >> (kSlotBits * level)) & (kSlots - 1));
+		entry.level = static_cast<uint8_t>(level);
+		entry.slot = static_cast<uint8_t>(slot);
+		uint32_t& head = m_slots[level][slot];
+		entry.prev = kNone;
+		entry.next = head;
+		if (head != kNone) m_entries[head].prev = index;
+		head = index;
+		m_occupied[level] |= uint64_t(1) << slot;
+	}
+
+	// Detaches the list of a slot and returns its first entry.
+	uint32_t TimerWheel::TakeSlot(int level, int slot) {
+		const uint32_t head = m_slots[level][slot];
+		m_slots[level][slot] = kNone;
+		m_occupied[level] &= ~(uint64_t(1) << slot);
+		return head;
+	}
+
+	void TimerWheel::Cascade(int level) {
+		const int slot = static_cast<int>((m_current >> (kSlotBits * level)) & (kSlots - 1));
+		// The level above refills this one, so it goes first.
+		if (slot == 0 && level + 1 < kLevels) Cascade(level + 1);
+		for (uint32_t index = TakeSlot(level, slot); index != kNone;) {
+			const uint32_t next = m_entries[index].next;
+			Link(index);
+			index = next;
+		}
+	}
+
+	void TimerWheel::Advance(uint64_t now, std::vector<QueuedOutput>& due) {
+		const uint64_t target = now / kTickUs;
+		while (m_current <= target) {
+			if (m_size == 0) {
+				m_current = target + 1;
+				break;
+			}
+			if ((m_current & (kSlots - 1)) == 0) Cascade(1);
+			for (uint32_t index = TakeSlot(0, static_cast<int>(m_current & (kSlots - 1))); index != kNone;) {
+				Entry& entry = m_entries[index];
+				const uint32_t next = entry.next;
+				if (entry.tick <= m_current) {
+					due.push_back(std::move(entry.output));
+					Release(index);
+				}
+				else {
+					Link(index);
+				}
+				index = next;
+			}
+			m_current++;
+		}
+	}
+
+	uint64_t TimerWheel::NextDue() const {
+		if (m_size == 0) return 0;
+		const int slot = static_cast<int>(m_current & (kSlots - 1));
+		// The current tick starts a turn of level 0 and has yet to cascade the levels above.
+		if (slot == 0) return m_current * kTickUs;
+		const uint64_t ahead = m_occupied[0] >> slot;
+		// Slots behind the current one belong to the next turn of level 0, which starts with a cascade.
+		const uint64_t tick = ahead != 0 ? m_current + std::countr_zero(ahead) : (m_current | (kSlots - 1)) + 1;
+		return tick * kTickUs;
+	}
+
+	void TimerWheel::Clear() {
+		for (auto& level : m_slots) {
+			level.fill(kNone);
+		}
+		m_occupied.fill(0);
+		for (uint32_t index = 0; index < m_entries.size(); ++index) {
+			Entry& entry = m_entries[index];
+			entry.output = QueuedOutput();
+			entry.used = false;
+			entry.prev = kNone;
+			entry.next = index + 1 < m_entries.size() ? index + 1 : kNone;
+		}
+		m_free = m_entries.empty() ? kNone : 0;
+		m_size = 0;
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+#pragma once
+#include "Allocations.h"
+#include "OutputQueue.h"
+#include <stdint.h>
+#include <array>
+#include <vector>
+
+namespace Sral {
+
+	// A hierarchical timer wheel of scheduled output (SRAL_SpeakAt).
+	// Level 0 has one slot per tick; each higher level has slots kSlots times as wide, and its timers are
+	// cascaded down a level when the level below wraps around. Adding a timer is O(1) regardless of how
+	// many are scheduled, and only the slot of the current tick is looked at when advancing.
+	// Timers are never fired early: a timer goes into the first tick that starts at or after its due time.
+	// Times are LatencyTracker::Now() microseconds. Not thread safe; SRAL.cpp guards it with a mutex.
+	class TimerWheel {
+	public:
+		static constexpr uint64_t kTickUs = 100;
+		static constexpr int kLevels = 4;
+		static constexpr int kSlotBits = 6;
+		static constexpr int kSlots = 1 << kSlotBits;
+
+		explicit TimerWheel(uint64_t now = 0);
+
+		// Ids have the top bit set, so that they never equal an OutputQueue id.
+		static constexpr uint64_t kIdFlag = uint64_t(1) << 63;
+
+		// Schedules output at the given time and returns an id for it.
+		uint64_t Add(uint64_t now, uint64_t due, QueuedOutput&& output);
+
+		// Removes the timer with the given id if it has not fired yet.
+		bool Cancel(uint64_t id);
+		// Removes all timers with the given tag and returns how many were removed.
+		size_t CancelIf(int tag);
+
+		// Appends the output of all timers due at or before now to due, in tick order.
+		void Advance(uint64_t now, std::vector<QueuedOutput>& due);
+
+		// The time at which Advance should be called next, or 0 if no timer is scheduled.
+		uint64_t NextDue() const;
+
+		void Clear();
+		size_t Size() const {
+			return m_size;
+		}
+
+	private:
+		static constexpr uint32_t kNone = UINT32_MAX;
+
+		struct Entry {
+			QueuedOutput output;
+			uint64_t tick = 0;
+			uint32_t generation = 0;
+			bool used = false;
+			uint32_t prev = kNone;
+			uint32_t next = kNone;
+			uint8_t level = 0;
+			uint8_t slot = 0;
+		};
+
+		void Link(uint32_t index);
+		void Unlink(uint32_t index);
+		void Release(uint32_t index);
+		uint32_t TakeSlot(int level, int slot);
+		void Cascade(int level);
+
+		std::vector<Entry, Allocations::Allocator<Entry>> m_entries;
+		uint32_t m_free{kNone};
+		std::array<std::array<uint32_t, kSlots>, kLevels> m_slots;
+		std::array<uint64_t, kLevels> m_occupied{}; // One bit per non-empty slot.
+		uint64_t m_current; // The next tick to process.
+		size_t m_size{0};
+	};
+}
+
+#endif
@@ -0,0 +1,161 @@
+#include "Trace.h"
+#ifdef SRAL_TRACING
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#endif
+
+namespace Sral {
+	namespace Trace {
+#ifdef SRAL_TRACING
+		std::atomic<bool> g_enabled{false};
+
+		namespace {
+			struct Event {
+				const char* category;
+				const char* name;
+				uint64_t begin;
+				uint64_t duration;
+				int64_t arg;
+				uint32_t tid;
+				char phase;
+			};
+
+			// Single-producer ring: only the owning thread writes, Dump() only reads.
+			struct ThreadBuffer {
+				static constexpr uint64_t kCapacity = 4096;
+				Event events[kCapacity];
+				std::atomic<uint64_t> head{0};
+				// Cleared when the owning thread exits, so a later thread can reuse the
+				// buffer while the events already in it stay available for dumping.
+				std::atomic<bool> owned{true};
+			};
+
+			// SRAL starts short-lived threads (the delayed output thread), so buffers are
+			// recycled rather than created per thread; past this many live threads, events are dropped.
+			constexpr size_t kMaxBuffers = 64;
+
+			std::mutex g_buffersMutex;
+			std::vector<std::unique_ptr<ThreadBuffer>> g_buffers;
+			std::atomic<uint32_t> g_nextThreadId{1};
+
+			struct ThreadSlot {
+				ThreadBuffer* buffer = nullptr;
+				bool exhausted = false;
+				uint32_t id = g_nextThreadId.fetch_add(1, std::memory_order_relaxed);
+
+				~ThreadSlot() {
+					if (buffer) buffer->owned.store(false, std::memory_order_release);
+				}
+			};
+			thread_local ThreadSlot t_slot;
+
+			ThreadBuffer* AcquireBuffer() {
+				std::lock_guard<std::mutex> lock(g_buffersMutex);
+				for (auto& buffer : g_buffers) {
+					bool expected = false;
+					if (buffer->owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+						return buffer.get();
+					}
+				}
+				if (g_buffers.size() >= kMaxBuffers) return nullptr;
+				g_buffers.push_back(std::make_unique<ThreadBuffer>());
+				return g_buffers.back().get();
+			}
+
+			void WriteString(FILE* f, const char* str) {
+				fputc('"', f);
+				for (; str && *str; ++str) {
+					if (*str == '"' || *str == '\\') fputc('\\', f);
+					fputc(*str, f);
+				}
+				fputc('"', f);
+			}
+
+			void WriteMicroseconds(FILE* f, uint64_t ns) {
+				fprintf(f, "%llu.%03llu", (unsigned long long)(ns / 1000), (unsigned long long)(ns % 1000));
+			}
+		}
+
+		uint64_t Now() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		void Record(const char* category, const char* name, char phase, uint64_t begin, uint64_t duration, int64_t arg) {
+			ThreadSlot& slot = t_slot;
+			if (slot.buffer == nullptr) {
+				if (slot.exhausted) return;
+				slot.buffer = AcquireBuffer();
+				if (slot.buffer == nullptr) {
+					slot.exhausted = true;
+					return;
+				}
+			}
+			ThreadBuffer* buffer = slot.buffer;
+			const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+			Event& e = buffer->events[head % ThreadBuffer::kCapacity];
+			e.category = category;
+			e.name = name;
+			e.begin = begin;
+			e.duration = duration;
+			e.arg = arg;
+			e.tid = slot.id;
+			e.phase = phase;
+			buffer->head.store(head + 1, std::memory_order_release);
+		}
+
+		bool SetEnabled(bool enable) {
+			g_enabled.store(enable);
+			return true;
+		}
+
+		bool Dump(const char* path) {
+			if (path == nullptr) return false;
+			FILE* f = fopen(path, "wb");
+			if (f == nullptr) return false;
+
+			fputs("{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"SRAL\"}}", f);
+			std::lock_guard<std::mutex> lock(g_buffersMutex);
+			for (auto& buffer : g_buffers) {
+				const uint64_t end = buffer->head.load(std::memory_order_acquire);
+				const uint64_t begin = end > ThreadBuffer::kCapacity ? end - ThreadBuffer::kCapacity : 0;
+				for (uint64_t i = begin; i < end; ++i) {
+					const Event e = buffer->events[i % ThreadBuffer::kCapacity];
+					// The owner may have wrapped around onto this slot while we were copying it; once head - i reaches the
+					// capacity, the owner is writing slot i.
+					if (buffer->head.load(std::memory_order_acquire) - i >= ThreadBuffer::kCapacity) continue;
+
+					fputs(",\n{\"cat\":", f);
+					WriteString(f, e.category);
+					fputs(",\"name\":", f);
+					WriteString(f, e.name);
+					fprintf(f, ",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":", e.phase, e.tid);
+					WriteMicroseconds(f, e.begin);
+					if (e.phase == 'X') {
+						fputs(",\"dur\":", f);
+						WriteMicroseconds(f, e.duration);
+					}
+					else {
+						fputs(",\"s\":\"t\"", f);
+					}
+					fprintf(f, ",\"args\":{\"value\":%lld}}", (long long)e.arg);
+				}
+			}
+			fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+			return fclose(f) == 0;
+		}
+#else
+		bool SetEnabled(bool enable) {
+			(void)enable;
+			return false;
+		}
+
+		bool Dump(const char* path) {
+			(void)path;
+			return false;
+		}
+#endif
+	}
+}
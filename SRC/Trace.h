@@ -0,0 +1,75 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// Span and event recording for Chrome trace-event / Perfetto export.
+// Everything here compiles away unless SRAL is built with SRAL_ENABLE_TRACING,
+// and even then it costs a single relaxed load until tracing is switched on at runtime.
+
+namespace Sral {
+	namespace Trace {
+		bool SetEnabled(bool enable);
+		bool Dump(const char* path);
+
+#ifdef SRAL_TRACING
+		extern std::atomic<bool> g_enabled;
+
+		inline bool Enabled() {
+			return g_enabled.load(std::memory_order_relaxed);
+		}
+
+		uint64_t Now();
+
+		// Appends to the calling thread's ring buffer. Never blocks once the buffer exists.
+		void Record(const char* category, const char* name, char phase, uint64_t begin, uint64_t duration, int64_t arg);
+
+		class Scope {
+		public:
+			Scope(const char* category, const char* name, int64_t arg = 0) {
+				if (!Enabled()) return;
+				m_category = category;
+				m_name = name;
+				m_arg = arg;
+				m_begin = Now();
+			}
+
+			~Scope() {
+				if (m_name == nullptr) return;
+				Record(m_category, m_name, 'X', m_begin, Now() - m_begin, m_arg);
+			}
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			const char* m_category = nullptr;
+			const char* m_name = nullptr;
+			int64_t m_arg = 0;
+			uint64_t m_begin = 0;
+		};
+#endif
+	}
+}
+
+#ifdef SRAL_TRACING
+#define SRAL_TRACE_CONCAT_(a, b) a##b
+#define SRAL_TRACE_CONCAT(a, b) SRAL_TRACE_CONCAT_(a, b)
+// Span covering the rest of the enclosing block. The argument is only evaluated while tracing.
+#define SRAL_TRACE_SCOPE(category, name, arg) ::Sral::Trace::Scope SRAL_TRACE_CONCAT(sral_trace_scope_, __LINE__)(category, name, ::Sral::Trace::Enabled() ? (arg) : 0)
+// Span covering the rest of a public SRAL_* function, named after it.
+#define SRAL_TRACE_API() SRAL_TRACE_SCOPE("api", __func__, 0)
+// Span that started at an earlier Sral::Trace::Now() timestamp and ends here.
+#define SRAL_TRACE_SINCE(category, name, begin, arg) do { if (::Sral::Trace::Enabled() && (begin) != 0) { const uint64_t sral_trace_now_ = ::Sral::Trace::Now(); ::Sral::Trace::Record(category, name, 'X', begin, sral_trace_now_ - (begin), arg); } } while (0)
+#define SRAL_TRACE_INSTANT(category, name, arg) do { if (::Sral::Trace::Enabled()) ::Sral::Trace::Record(category, name, 'i', ::Sral::Trace::Now(), 0, arg); } while (0)
+#define SRAL_TRACE_NOW() (::Sral::Trace::Enabled() ? ::Sral::Trace::Now() : 0)
+#else
+#define SRAL_TRACE_SCOPE(category, name, arg) ((void)0)
+#define SRAL_TRACE_API() ((void)0)
+#define SRAL_TRACE_SINCE(category, name, begin, arg) ((void)0)
+#define SRAL_TRACE_INSTANT(category, name, arg) ((void)0)
+#define SRAL_TRACE_NOW() (uint64_t(0))
+#endif
+
+#endif
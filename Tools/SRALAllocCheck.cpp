@@ -0,0 +1,102 @@
+// sral-alloc-check: checks that speaking through the direct path does not allocate once SRAL has warmed up.
+// Installs a no-op engine, makes a few calls to let the per-thread buffers grow, then counts the allocations
+// of many more with SRAL_GetAllocationCount. Exits with 1 if any call allocated, so CI can run it.
+// Only meaningful in a build with the SRAL_COUNT_ALLOCATIONS option.
+
+#define SRAL_STATIC
+#include <SRAL.h>
+#include "../SRC/Engine.h"
+#include <cstdio>
+#include <memory>
+
+// Accepts everything instantly and never reports speaking.
+class NullEngine final : public Sral::Engine {
+public:
+	bool Speak(const char* text, bool interrupt)override {
+		(void)text;
+		(void)interrupt;
+		return true;
+	}
+	bool SpeakSsml(const char* ssml, bool interrupt)override {
+		(void)ssml;
+		(void)interrupt;
+		return true;
+	}
+	bool Braille(const char* text)override {
+		(void)text;
+		return true;
+	}
+	bool StopSpeech()override {
+		return true;
+	}
+	bool IsSpeaking()override {
+		return false;
+	}
+	int GetNumber()override {
+		return SRAL_ENGINE_NVDA;
+	}
+	bool GetActive()override {
+		return true;
+	}
+	int GetFeatures()override {
+		return SRAL_SUPPORTS_SPEECH | SRAL_SUPPORTS_BRAILLE | SRAL_SUPPORTS_SSML;
+	}
+	bool Initialize()override {
+		return true;
+	}
+	bool Uninitialize()override {
+		return true;
+	}
+};
+
+static const char kText[] = "A message long enough not to fit in a small string buffer, with <markup> & \"quotes\" to encode.";
+static const int kWarmUp = 16;
+static const int kCalls = 1000;
+
+// Returns the number of allocations made by kCalls calls of call, after warming it up.
+template <typename F>
+static uint64_t CountAllocations(F&& call) {
+	for (int i = 0; i < kWarmUp; ++i) call();
+	uint64_t before = 0;
+	uint64_t after = 0;
+	SRAL_GetAllocationCount(&before);
+	for (int i = 0; i < kCalls; ++i) call();
+	SRAL_GetAllocationCount(&after);
+	return after - before;
+}
+
+int main() {
+	uint64_t count;
+	if (!SRAL_GetAllocationCount(&count)) {
+		fprintf(stderr, "Allocation counting is not compiled in; build with SRAL_COUNT_ALLOCATIONS\n");
+		return 1;
+	}
+	if (!Sral::InstallEngine(std::make_unique<NullEngine>())) {
+		fprintf(stderr, "Cannot install the no-op engine\n");
+		return 1;
+	}
+
+	struct Check {
+		const char* name;
+		uint64_t allocations;
+	};
+	const Check checks[] = {
+		{ "SRAL_Speak", CountAllocations([] { SRAL_Speak(kText, false); }) },
+		{ "SRAL_SpeakEx", CountAllocations([] { SRAL_SpeakEx(SRAL_ENGINE_NVDA, kText, true); }) },
+		{ "SRAL_SpeakSsml", CountAllocations([] { SRAL_SpeakSsml(kText, false); }) },
+		{ "SRAL_Braille", CountAllocations([] { SRAL_Braille(kText); }) },
+		{ "SRAL_Speak (adaptive selection)", CountAllocations([] { SRAL_SetAdaptiveEngineSelection(true); SRAL_Speak(kText, false); }) },
+	};
+
+	int failed = 0;
+	for (const Check& check : checks) {
+		printf("%-32s %llu allocations in %d calls\n", check.name, static_cast<unsigned long long>(check.allocations), kCalls);
+		if (check.allocations != 0) failed++;
+	}
+	SRAL_Uninitialize();
+	if (failed != 0) {
+		fprintf(stderr, "%d of the direct speak paths allocated\n", failed);
+		return 1;
+	}
+	return 0;
+}
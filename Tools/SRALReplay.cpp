@@ -0,0 +1,519 @@
+// sral-replay: replays a recording made with SRAL_StartRecording.
+// Calls are issued from one thread per recorded thread, at the recorded times (optionally sped up),
+// against the real engines or against a built-in no-op engine that only simulates speech duration.
+// This reproduces a session's burst patterns and reports how long each SRAL call took.
+
+#define SRAL_STATIC
+#include <SRAL.h>
+#include "../SRC/Engine.h"
+#include "../SRC/Latency.h"
+#include "../SRC/Recorder.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using Sral::Recorder::TraceRecord;
+using Clock = std::chrono::steady_clock;
+
+// Accepts everything instantly and pretends to speak for a time proportional to the text size,
+// so that IsSpeaking() and the delayed output queue behave like they would with a real synthesizer.
+class NullEngine final : public Sral::Engine {
+public:
+	NullEngine(int number, double msPerByte) : m_number(number), m_msPerByte(msPerByte) {}
+
+	bool Speak(const char* text, bool interrupt)override {
+		return Say(strlen(text), interrupt);
+	}
+	bool SpeakSsml(const char* ssml, bool interrupt)override {
+		return Say(strlen(ssml), interrupt);
+	}
+	void* SpeakToMemory(const char* text, uint64_t* buffer_size, int* channels, int* sample_rate, int* bits_per_sample)override {
+		const uint64_t size = static_cast<uint64_t>(strlen(text) * m_msPerByte * 16) * 2;
+		void* buffer = SRAL_malloc(size ? size : 2);
+		if (buffer == nullptr) return nullptr;
+		memset(buffer, 0, size ? size : 2);
+		if (buffer_size) *buffer_size = size;
+		if (channels) *channels = 1;
+		if (sample_rate) *sample_rate = 16000;
+		if (bits_per_sample) *bits_per_sample = 16;
+		return buffer;
+	}
+	bool Braille(const char* text)override {
+		(void)text;
+		return true;
+	}
+	bool StopSpeech()override {
+		m_busyUntil.store(0);
+		paused = false;
+		return true;
+	}
+	bool PauseSpeech()override {
+		paused = true;
+		return true;
+	}
+	bool ResumeSpeech()override {
+		paused = false;
+		return true;
+	}
+	bool IsSpeaking()override {
+		return !paused && Now() < m_busyUntil.load();
+	}
+	int GetNumber()override {
+		return m_number;
+	}
+	bool GetActive()override {
+		return true;
+	}
+	int GetFeatures()override {
+		return SRAL_SUPPORTS_SPEECH | SRAL_SUPPORTS_BRAILLE | SRAL_SUPPORTS_SPEECH_RATE | SRAL_SUPPORTS_SPEECH_VOLUME | SRAL_SUPPORTS_SELECT_VOICE | SRAL_SUPPORTS_PAUSE_SPEECH | SRAL_SUPPORTS_SSML | SRAL_SUPPORTS_SPEAK_TO_MEMORY | SRAL_SUPPORTS_SPELLING;
+	}
+	bool Initialize()override {
+		return true;
+	}
+	bool Uninitialize()override {
+		return true;
+	}
+	bool SetParameter(int param, const void* value)override {
+		if (value == nullptr) return false;
+		m_params[param] = *reinterpret_cast<const int*>(value);
+		return true;
+	}
+	bool GetParameter(int param, void* value)override {
+		if (value == nullptr) return false;
+		switch (param) {
+		case SRAL_PARAM_VOICE_COUNT:
+			*(int*)value = 1;
+			return true;
+		case SRAL_PARAM_VOICE_PROPERTIES: {
+			SRAL_VoiceInfo* voices = (SRAL_VoiceInfo*)value;
+			voices[0].index = 0;
+			voices[0].name = "Null";
+			voices[0].language = "en-US";
+			voices[0].gender = "Unknown";
+			voices[0].vendor = "SRAL";
+			return true;
+		}
+		default:
+			*(int*)value = m_params[param];
+			return true;
+		}
+	}
+
+private:
+	static int64_t Now() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+	}
+
+	bool Say(size_t size, bool interrupt) {
+		const int64_t now = Now();
+		const int64_t duration = static_cast<int64_t>(size * m_msPerByte * 1000);
+		int64_t start = interrupt ? now : m_busyUntil.load();
+		if (start < now) start = now;
+		m_busyUntil.store(start + duration);
+		if (paused) paused = false;
+		return true;
+	}
+
+	int m_number;
+	double m_msPerByte;
+	std::atomic<int64_t> m_busyUntil{0};
+	std::map<int, int> m_params;
+};
+
+
+
+struct Options {
+	const char* path = nullptr;
+	double speed = 1.0;
+	int engine = 0;
+	bool null = false;
+	double msPerByte = 60.0;
+};
+
+static void PrintUsage() {
+	printf("Usage: sral-replay <recording> [options]\n"
+		"  --speed <factor>     Replay speed, 1 = original timing, 0 = as fast as possible (default 1)\n"
+		"  --engine <id>        Send every call to this engine (SRAL_Engines value)\n"
+		"  --null               Replace the engine with a no-op engine that only simulates speech time\n"
+		"  --ms-per-byte <ms>   Simulated speech time per byte of text for --null (default 60)\n");
+}
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(arg, "--speed") == 0 && hasValue) options.speed = atof(argv[++i]);
+		else if (strcmp(arg, "--engine") == 0 && hasValue) options.engine = atoi(argv[++i]);
+		else if (strcmp(arg, "--ms-per-byte") == 0 && hasValue) options.msPerByte = atof(argv[++i]);
+		else if (strcmp(arg, "--null") == 0) options.null = true;
+		else if (arg[0] != '-' && options.path == nullptr) options.path = arg;
+		else return false;
+	}
+	return options.path != nullptr && options.speed >= 0;
+}
+
+// Reads the records and the argument block of each.
+static bool LoadRecording(const char* path, std::vector<TraceRecord>& records, std::vector<std::string>& arguments) {
+	FILE* f = fopen(path, "rb");
+	if (f == nullptr) return false;
+	Sral::Recorder::TraceHeader header;
+	bool ok = fread(&header, sizeof(header), 1, f) == 1
+		&& memcmp(header.magic, Sral::Recorder::kMagic, sizeof(header.magic)) == 0
+		&& header.version == Sral::Recorder::kVersion
+		&& header.recordSize == sizeof(TraceRecord);
+	TraceRecord record;
+	while (ok && fread(&record, sizeof(record), 1, f) == 1) {
+		std::string block(record.data, '\0');
+		if (record.data && fread(&block[0], record.data, 1, f) != 1) break;
+		records.push_back(record);
+		arguments.push_back(std::move(block));
+	}
+	fclose(f);
+	return ok;
+}
+
+// Utterance ids are different in the replay; calls that take one get the id of the replayed call instead.
+static std::mutex g_idsMutex;
+static std::unordered_map<uint64_t, uint64_t> g_ids;
+
+static uint64_t MapId(uint64_t recorded, uint64_t replayed) {
+	if (recorded != 0 && replayed != 0) {
+		std::lock_guard<std::mutex> lock(g_idsMutex);
+		g_ids[recorded] = replayed;
+	}
+	return replayed;
+}
+
+// Returns 0 for ids that were never replayed, which cancels nothing.
+static uint64_t ReplayedId(uint64_t recorded) {
+	std::lock_guard<std::mutex> lock(g_idsMutex);
+	auto it = g_ids.find(recorded);
+	return it != g_ids.end() ? it->second : 0;
+}
+
+// Copies the argument block of a record to out, if it holds count values of T.
+template <typename T>
+static bool Arguments(const std::string& block, T* out, size_t count) {
+	if (block.size() != sizeof(T) * count) return false;
+	memcpy(out, block.data(), block.size());
+	return true;
+}
+
+// Stands in for the recorded text filters, whose code is not in the recording.
+static const char* PassThrough(const char* text, void* user_data) {
+	(void)user_data;
+	return text;
+}
+
+// Stands in for the recorded utterance callback, so that marks are still delivered.
+static void IgnoreMark(uint64_t utterance_id, void* user_data) {
+	(void)utterance_id;
+	(void)user_data;
+}
+
+// Stand in for the recorded allocator, so that allocations still go through hooks.
+static void* ReplayAlloc(size_t size, void* user_data) {
+	(void)user_data;
+	return malloc(size);
+}
+
+static void* ReplayRealloc(void* memory, size_t size, void* user_data) {
+	(void)user_data;
+	return realloc(memory, size);
+}
+
+static void ReplayFree(void* memory, void* user_data) {
+	(void)user_data;
+	free(memory);
+}
+
+static std::string MakeText(uint32_t size) {
+	static const char kWords[] = "lorem ipsum dolor sit amet ";
+	std::string text;
+	text.reserve(size);
+	for (uint32_t i = 0; i < size; ++i) {
+		text += kWords[i % (sizeof(kWords) - 1)];
+	}
+	return text;
+}
+
+static void Execute(const TraceRecord& r, const char* text, const std::string& arguments, int engineOverride, int protectedEngines) {
+	using namespace Sral::Recorder;
+	const bool explicitEngine = engineOverride != 0 || (r.flags & FLAG_EXPLICIT_ENGINE);
+	const int engine = engineOverride != 0 ? engineOverride : r.engine;
+	const bool interrupt = (r.flags & FLAG_INTERRUPT) != 0;
+	switch (r.call) {
+	case CALL_SPEAK:
+		explicitEngine ? SRAL_SpeakEx(engine, text, interrupt) : SRAL_Speak(text, interrupt);
+		break;
+	case CALL_SPEAK_TO_MEMORY: {
+		uint64_t size = 0;
+		int channels = 0, sampleRate = 0, bits = 0;
+		void* buffer = explicitEngine ? SRAL_SpeakToMemoryEx(engine, text, &size, &channels, &sampleRate, &bits) : SRAL_SpeakToMemory(text, &size, &channels, &sampleRate, &bits);
+		if (buffer) SRAL_free(buffer);
+		break;
+	}
+	case CALL_SPEAK_SSML:
+		explicitEngine ? SRAL_SpeakSsmlEx(engine, text, interrupt) : SRAL_SpeakSsml(text, interrupt);
+		break;
+	case CALL_BRAILLE:
+		explicitEngine ? SRAL_BrailleEx(engine, text) : SRAL_Braille(text);
+		break;
+	case CALL_OUTPUT:
+		explicitEngine ? SRAL_OutputEx(engine, text, interrupt) : SRAL_Output(text, interrupt);
+		break;
+	case CALL_STOP_SPEECH:
+		explicitEngine ? SRAL_StopSpeechEx(engine) : SRAL_StopSpeech();
+		break;
+	case CALL_PAUSE_SPEECH:
+		explicitEngine ? SRAL_PauseSpeechEx(engine) : SRAL_PauseSpeech();
+		break;
+	case CALL_RESUME_SPEECH:
+		explicitEngine ? SRAL_ResumeSpeechEx(engine) : SRAL_ResumeSpeech();
+		break;
+	case CALL_IS_SPEAKING:
+		explicitEngine ? SRAL_IsSpeakingEx(engine) : SRAL_IsSpeaking();
+		break;
+	case CALL_GET_CURRENT_ENGINE:
+		SRAL_GetCurrentEngine();
+		break;
+	case CALL_SET_ENGINE_PARAMETER:
+		if (r.flags & FLAG_HAS_VALUE) {
+			if (r.arg == SRAL_PARAM_ENABLE_SPELLING || r.arg == SRAL_PARAM_USE_CHARACTER_DESCRIPTIONS) {
+				const bool value = r.value != 0;
+				SRAL_SetEngineParameter(explicitEngine ? engine : 0, r.arg, &value);
+			}
+			else {
+				const int value = r.value;
+				SRAL_SetEngineParameter(explicitEngine ? engine : 0, r.arg, &value);
+			}
+		}
+		break;
+	case CALL_GET_ENGINE_PARAMETER:
+		if (r.arg == SRAL_PARAM_VOICE_PROPERTIES) {
+			int count = 0;
+			if (SRAL_GetEngineParameter(explicitEngine ? engine : 0, SRAL_PARAM_VOICE_COUNT, &count) && count > 0) {
+				std::vector<SRAL_VoiceInfo> voices(count);
+				SRAL_GetEngineParameter(explicitEngine ? engine : 0, SRAL_PARAM_VOICE_PROPERTIES, voices.data());
+			}
+		}
+		else {
+			// Large enough for every scalar parameter type (int, long, bool).
+			int64_t value = 0;
+			SRAL_GetEngineParameter(explicitEngine ? engine : 0, r.arg, &value);
+		}
+		break;
+	case CALL_DELAY:
+		SRAL_Delay(r.arg);
+		break;
+	case CALL_GET_ACTIVE_ENGINES:
+		SRAL_GetActiveEngines();
+		break;
+	case CALL_SET_ENGINES_EXCLUDE:
+		SRAL_SetEnginesExclude(r.arg & ~protectedEngines);
+		break;
+	case CALL_SPEAK_ON_CHANNEL:
+		MapId(r.id, SRAL_SpeakOnChannel(r.arg, text, r.value));
+		break;
+	case CALL_SET_FAILOVER_POLICY: {
+		int32_t args[3];
+		if (Arguments(arguments, args, 3)) SRAL_SetFailoverPolicy(args[0] != 0, args[1], args[2]);
+		break;
+	}
+	case CALL_SET_ENGINE_PRIORITY: {
+		std::vector<int> order(r.arg > 0 ? r.arg : 0);
+		if (order.empty() || Arguments(arguments, order.data(), order.size())) SRAL_SetEnginePriority(order.data(), r.arg);
+		break;
+	}
+	case CALL_SET_ADAPTIVE_ENGINE_SELECTION:
+		SRAL_SetAdaptiveEngineSelection(r.arg != 0);
+		break;
+	case CALL_ADD_TEXT_FILTER:
+		SRAL_AddTextFilter(explicitEngine ? engine : 0, PassThrough, nullptr);
+		break;
+	case CALL_ADD_RATE_LIMIT:
+		SRAL_AddRateLimit(explicitEngine ? engine : 0, r.arg, r.value);
+		break;
+	case CALL_CLEAR_MIDDLEWARE:
+		SRAL_ClearMiddleware(explicitEngine ? engine : 0);
+		break;
+	case CALL_ADD_COALESCER:
+		SRAL_AddCoalescer(explicitEngine ? engine : 0, r.arg);
+		break;
+	case CALL_SET_OUTPUT_TTL:
+		SRAL_SetOutputTTL(r.arg);
+		break;
+	case CALL_SET_QUEUE_LIMITS: {
+		int32_t args[4];
+		if (Arguments(arguments, args, 4)) SRAL_SetQueueLimits(args[0], args[1], args[2], args[3]);
+		break;
+	}
+	case CALL_SPEAK_AT:
+	case CALL_SPEAK_AFTER: {
+		// The block holds the delay, also for SpeakAt, whose deadline is relative to the recording's clock.
+		uint64_t delay;
+		if (!Arguments(arguments, &delay, 1)) break;
+		const int target = explicitEngine ? engine : 0;
+		const uint64_t id = r.call == CALL_SPEAK_AT ? SRAL_SpeakAt(target, text, SRAL_GetMonotonicTime() + delay, r.value) : SRAL_SpeakAfter(target, text, delay, r.value);
+		MapId(r.id, id);
+		break;
+	}
+	case CALL_SET_OUTPUT_TAG:
+		SRAL_SetOutputTag(r.arg);
+		break;
+	case CALL_CANCEL:
+		SRAL_Cancel(ReplayedId(r.id));
+		break;
+	case CALL_CANCEL_IF:
+		SRAL_CancelIf(r.arg);
+		break;
+	case CALL_SET_AGGREGATION: {
+		int32_t args[3];
+		if (Arguments(arguments, args, 3)) SRAL_SetAggregation(args[0], args[1], args[2]);
+		break;
+	}
+	case CALL_SET_UTTERANCE_CALLBACK:
+		SRAL_SetUtteranceCallback(r.arg ? IgnoreMark : nullptr, nullptr);
+		break;
+	case CALL_PUMP: {
+		uint64_t maxTime;
+		if (Arguments(arguments, &maxTime, 1)) SRAL_Pump(maxTime);
+		break;
+	}
+	case CALL_SPEAK_WITH_PARAMS: {
+		int32_t args[4];
+		if (!Arguments(arguments, args, 4)) break;
+		SRAL_UtteranceParams params{};
+		params.flags = args[0];
+		params.rate = args[1];
+		params.volume = args[2];
+		params.voice_index = args[3];
+		params.interrupt = interrupt;
+		explicitEngine ? SRAL_SpeakWithParamsEx(engine, text, &params) : SRAL_SpeakWithParams(text, &params);
+		break;
+	}
+	case CALL_SET_ENGINE_PARAMETERS:
+	case CALL_GET_ENGINE_PARAMETERS: {
+		// Parameter, type and value of each entry for Set, only the parameter for Get.
+		const bool set = r.call == CALL_SET_ENGINE_PARAMETERS;
+		const size_t fields = set ? 3 : 1;
+		const size_t count = r.arg > 0 ? r.arg : 0;
+		std::vector<int32_t> block(count * fields);
+		if (count == 0 || !Arguments(arguments, block.data(), block.size())) break;
+		std::vector<SRAL_ParamValue> values(count);
+		for (size_t i = 0; i < count; ++i) {
+			SRAL_ParamValue& v = values[i];
+			v.param = block[i * fields];
+			if (!set) continue;
+			v.type = block[i * fields + 1];
+			if (v.type == SRAL_PARAM_TYPE_BOOL) v.value.bool_value = block[i * fields + 2] != 0;
+			else v.value.int_value = block[i * fields + 2];
+		}
+		const int target = explicitEngine ? engine : 0;
+		set ? SRAL_SetEngineParameters(target, values.data(), r.arg) : SRAL_GetEngineParameters(target, values.data(), r.arg);
+		break;
+	}
+	case CALL_SET_ALLOCATOR:
+		if (r.arg) SRAL_SetAllocator(ReplayAlloc, ReplayRealloc, ReplayFree, nullptr);
+		else SRAL_SetAllocator(nullptr, nullptr, nullptr, nullptr);
+		break;
+	default:
+		break;
+	}
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage();
+		return 1;
+	}
+
+	std::vector<TraceRecord> records;
+	std::vector<std::string> arguments;
+	if (!LoadRecording(options.path, records, arguments)) {
+		fprintf(stderr, "Cannot read recording %s\n", options.path);
+		return 1;
+	}
+
+	// A session that pumped SRAL itself is replayed the same way, by its recorded SRAL_Pump calls.
+	int initFlags = 0;
+	for (const TraceRecord& r : records) {
+		if (r.call == Sral::Recorder::CALL_INITIALIZE && (r.flags & Sral::Recorder::FLAG_HAS_VALUE)) initFlags |= r.value & SRAL_INIT_PUMP;
+	}
+	const bool initialized = SRAL_InitializeEx(0, initFlags);
+	int nullEngine = 0;
+	if (options.null) {
+		nullEngine = options.engine;
+		if (nullEngine == 0) {
+			// Take the slot of the highest-priority engine on this platform so that auto selection picks it.
+			const int available = SRAL_GetAvailableEngines();
+			nullEngine = available & -available;
+		}
+		if (nullEngine == 0 || !Sral::InstallEngine(std::make_unique<NullEngine>(nullEngine, options.msPerByte))) {
+			fprintf(stderr, "Cannot install the no-op engine\n");
+			return 1;
+		}
+	}
+	else if (!initialized) {
+		fprintf(stderr, "SRAL_Initialize failed\n");
+		return 1;
+	}
+
+	// One replay thread per recorded thread, each following its own timeline.
+	std::map<uint32_t, std::vector<size_t>> threads;
+	std::vector<std::string> texts(records.size());
+	for (size_t i = 0; i < records.size(); ++i) {
+		threads[records[i].thread].push_back(i);
+		texts[i] = MakeText(records[i].payload);
+	}
+
+	std::vector<std::vector<Sral::LatencyHistogram>> histograms(threads.size(), std::vector<Sral::LatencyHistogram>(Sral::Recorder::CALL_COUNT));
+	std::vector<std::thread> workers;
+	const Clock::time_point start = Clock::now();
+	size_t worker = 0;
+	for (const auto& [id, indices] : threads) {
+		std::vector<Sral::LatencyHistogram>& own = histograms[worker++];
+		workers.emplace_back([&, indices = indices, &own = own] {
+			for (size_t i : indices) {
+				const TraceRecord& r = records[i];
+				// Initialization is driven by the tool itself.
+				if (r.call == Sral::Recorder::CALL_INITIALIZE || r.call == Sral::Recorder::CALL_UNINITIALIZE) continue;
+				if (options.speed > 0) {
+					std::this_thread::sleep_until(start + std::chrono::nanoseconds(static_cast<int64_t>(r.time / options.speed)));
+				}
+				const Clock::time_point begin = Clock::now();
+				Execute(r, texts[i].c_str(), arguments[i], options.engine, nullEngine);
+				const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count();
+				if (r.call < Sral::Recorder::CALL_COUNT) own[r.call].Add(us);
+			}
+		});
+	}
+	for (auto& thread : workers) thread.join();
+	const double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	printf("Replayed %zu calls from %zu threads in %.1f ms%s\n", records.size(), threads.size(), elapsed, options.null ? " (no-op engine)" : "");
+	printf("%-26s %8s %10s %10s %10s %10s\n", "call", "count", "mean_us", "p50_us", "p99_us", "max_us");
+	for (int call = 1; call < Sral::Recorder::CALL_COUNT; ++call) {
+		Sral::LatencyHistogram merged;
+		for (auto& own : histograms) {
+			merged.Merge(own[call]);
+		}
+		SRAL_LatencyDistribution d;
+		merged.Export(&d);
+		if (d.count == 0) continue;
+		printf("%-26s %8llu %10llu %10llu %10llu %10llu\n", Sral::Recorder::CallName(call), (unsigned long long)d.count,
+			(unsigned long long)d.mean_us, (unsigned long long)d.p50_us, (unsigned long long)d.p99_us, (unsigned long long)d.max_us);
+	}
+
+	SRAL_Uninitialize();
+	return 0;
+}
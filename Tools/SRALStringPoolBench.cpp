@@ -0,0 +1,95 @@
+// sral-stringpool-bench: compares the string pool engines keep voice metadata in with copying every string.
+// Lists 5000 voices of 4 strings each 100 times, once the old way (a new char[] per string, all of them freed
+// before the next listing) and once through Sral::StringPool, and prints the time and allocations of each.
+// Allocations are only counted in a build with the SRAL_COUNT_ALLOCATIONS option; build optimized for timings.
+
+#define SRAL_STATIC
+#include <SRAL.h>
+#include "../SRC/StringPool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const int kVoices = 5000;
+static const int kListings = 100;
+
+struct Result {
+	double ms;
+	uint64_t allocations;
+};
+
+static uint64_t AllocationCount() {
+	uint64_t count = 0;
+	SRAL_GetAllocationCount(&count);
+	return count;
+}
+
+// Runs list kListings times and measures it.
+template <typename F>
+static Result Measure(F&& list) {
+	const auto start = std::chrono::steady_clock::now();
+	const uint64_t before = AllocationCount();
+	for (int i = 0; i < kListings; ++i) list();
+	const uint64_t after = AllocationCount();
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	return { elapsed.count(), after - before };
+}
+
+static void Print(const char* name, const Result& result, bool counted) {
+	if (counted) printf("%-20s %8.1f ms %10llu allocations\n", name, result.ms, static_cast<unsigned long long>(result.allocations));
+	else printf("%-20s %8.1f ms\n", name, result.ms);
+}
+
+int main() {
+	std::vector<std::string> names;
+	std::vector<std::string> languages;
+	names.reserve(kVoices);
+	languages.reserve(kVoices);
+	for (int i = 0; i < kVoices; ++i) {
+		names.push_back("Voice number " + std::to_string(i) + " (Neural, high quality)");
+		languages.push_back(i % 2 ? "en-US" : "de-DE");
+	}
+	uint64_t unused;
+	const bool counted = SRAL_GetAllocationCount(&unused);
+
+	// What Engine::AddString used to do: a copy per string, all released before the next listing.
+	std::vector<char*> copies;
+	copies.reserve(kVoices * 4);
+	const Result copied = Measure([&] {
+		for (char* copy : copies) delete[] copy;
+		copies.clear();
+		for (int i = 0; i < kVoices; ++i) {
+			for (const char* field : { names[i].c_str(), languages[i].c_str(), "female", "Unknown" }) {
+				char* copy = new char[strlen(field) + 1];
+				strcpy(copy, field);
+				copies.push_back(copy);
+			}
+		}
+	});
+	for (char* copy : copies) delete[] copy;
+
+	Sral::StringPool pool;
+	const char* first = nullptr;
+	bool stable = true;
+	const Result pooled = Measure([&] {
+		for (int i = 0; i < kVoices; ++i) {
+			const char* name = pool.Intern(names[i].c_str());
+			pool.Intern(languages[i].c_str());
+			pool.Intern("female");
+			pool.Intern("Unknown");
+			if (i == 0) {
+				if (first == nullptr) first = name;
+				else stable = stable && name == first;
+			}
+		}
+	});
+
+	printf("%d listings of %d voices\n", kListings, kVoices);
+	Print("new[] per string", copied, counted);
+	Print("StringPool", pooled, counted);
+	printf("The pool holds %zu strings in %zu bytes of blocks; pointers %s between listings\n", pool.Size(), pool.Bytes(), stable ? "stay the same" : "change");
+	if (!counted) printf("Build with SRAL_COUNT_ALLOCATIONS to count allocations\n");
+	return 0;
+}